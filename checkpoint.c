@@ -0,0 +1,29 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include "checkpoint.h"
+
+/* ******************************************************************
+   Reading and writing snapshots.  The state is written as it is held
+   in memory, with each module replacing the pointers it reads back by
+   its own.
+**********************************************************************/
+
+void checkpoint_write(FILE *fp, const void *data, size_t size)
+{
+  if (size > 0 && fwrite(data, size, 1, fp) != 1) {
+    printf("can not write snapshot\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void checkpoint_read(FILE *fp, void *data, size_t size)
+{
+  if (size > 0 && fread(data, size, 1, fp) != 1)
+    checkpoint_mismatch("the snapshot is too short");
+}
+
+void checkpoint_mismatch(const char *what)
+{
+  printf("can not restore snapshot: %s\n", what);
+  exit(EXIT_FAILURE);
+}
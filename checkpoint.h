@@ -0,0 +1,18 @@
+/* snapshots of a running simulation, taken at the time given by the
+   checkpoint option.  A snapshot holds the event list with the packets in
+   flight, the random number generator's position, the statistics and the
+   state of the protocol, the link, the loss models and the topology.  It
+   is a binary image, only readable by the same program run with the same
+   options; the values read from standard input may differ and apply from
+   the snapshot on.  Each module saves and restores its own state with
+   the two routines below. */
+
+/* write size bytes at data to the snapshot */
+extern void checkpoint_write(FILE *fp, const void *data, size_t size);
+
+/* read size bytes of the snapshot into data, stopping the simulation if
+   the snapshot is too short */
+extern void checkpoint_read(FILE *fp, void *data, size_t size);
+
+/* stop the simulation because the snapshot does not match this run */
+extern void checkpoint_mismatch(const char *what);
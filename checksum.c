@@ -0,0 +1,505 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "emulator.h"
+#include "checksum.h"
+
+/* ******************************************************************
+   Packet checksums used by the GBN and SR protocols.
+
+   Every algorithm is written as an update function over a 32 bit state,
+   so a packet can be checksummed in two pieces (seqnum and acknum, then
+   length and payload) without copying it to skip the checksum field.
+   Pieces other than the last must have an even length for the 16 bit
+   word algorithms.
+
+   The vector kernels are compiled with target attributes, so the file
+   builds without -mavx2 and the kernel is picked when the program runs.
+**********************************************************************/
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define CHECKSUM_X86 1
+#include <immintrin.h>
+#define TARGET(isa) __attribute__((target(isa)))
+#else
+#define CHECKSUM_X86 0
+#endif
+
+typedef uint32_t (*update_fn)(uint32_t state, const unsigned char *p, size_t len);
+
+/********* byte sum: the original checksum ************/
+
+static uint32_t sum_portable(uint32_t state, const unsigned char *p, size_t len)
+{
+  size_t i;
+
+  for (i=0; i<len; i++)
+    state += (uint32_t)(int)(signed char)p[i];
+  return state;
+}
+
+/********* Internet checksum (RFC 1071) ************/
+
+/* the state is a 32 bit sum of little endian 16 bit words, folded so it
+   can not overflow.  Summing in either byte order gives the same bytes
+   in the end (RFC 1071 section 2), so no byte swapping is needed. */
+
+static uint32_t fold16(uint64_t sum)
+{
+  while (sum >> 16)
+    sum = (sum & 0xffff) + (sum >> 16);
+  return (uint32_t)sum;
+}
+
+static uint32_t internet_portable(uint32_t state, const unsigned char *p, size_t len)
+{
+  uint64_t sum = state;
+  size_t i;
+
+  for (i=0; i+1<len; i+=2)
+    sum += (uint32_t)p[i] | ((uint32_t)p[i+1] << 8);
+  if (len & 1)
+    sum += p[len-1];
+  return fold16(sum);
+}
+
+static uint32_t internet_final(uint32_t state)
+{
+  return ~state & 0xffff;
+}
+
+#if CHECKSUM_X86
+/* each 32 bit lane gains at most 2 * 0xffff per step, so the lanes are
+   emptied into a 64 bit sum every INTERNET_BLOCK steps */
+#define INTERNET_BLOCK 16384
+
+TARGET("sse4.2")
+static uint32_t internet_sse42(uint32_t state, const unsigned char *p, size_t len)
+{
+  const __m128i mask = _mm_set1_epi32(0xffff);
+  uint64_t sum = state;
+  uint32_t lanes[4];
+  __m128i acc, v;
+  size_t n;
+
+  while (len >= 16) {
+    acc = _mm_setzero_si128();
+    for (n=0; n<INTERNET_BLOCK && len>=16; n++, p+=16, len-=16) {
+      v = _mm_loadu_si128((const __m128i *)p);
+      acc = _mm_add_epi32(acc, _mm_and_si128(v, mask));
+      acc = _mm_add_epi32(acc, _mm_srli_epi32(v, 16));
+    }
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  }
+  return internet_portable(fold16(sum), p, len);
+}
+
+TARGET("avx2")
+static uint32_t internet_avx2(uint32_t state, const unsigned char *p, size_t len)
+{
+  const __m256i mask = _mm256_set1_epi32(0xffff);
+  uint64_t sum = state;
+  uint32_t lanes[8];
+  __m256i acc, v;
+  size_t n;
+  int i;
+
+  while (len >= 32) {
+    acc = _mm256_setzero_si256();
+    for (n=0; n<INTERNET_BLOCK && len>=32; n++, p+=32, len-=32) {
+      v = _mm256_loadu_si256((const __m256i *)p);
+      acc = _mm256_add_epi32(acc, _mm256_and_si256(v, mask));
+      acc = _mm256_add_epi32(acc, _mm256_srli_epi32(v, 16));
+    }
+    _mm256_storeu_si256((__m256i *)lanes, acc);
+    for (i=0; i<8; i++)
+      sum += lanes[i];
+  }
+  return internet_sse42(fold16(sum), p, len);
+}
+#endif
+
+/********* Fletcher-32 ************/
+
+/* the state holds sum1 in the low and sum2 in the high 16 bits, both
+   modulo 65535.  Words are little endian, an odd last byte is padded
+   with zero. */
+
+/* sum1 starts at 1, as in Adler-32, so leading zero words still change sum2 */
+#define FLETCHER_INIT 1u
+
+/* 359 words is the most that can be summed before the 32 bit sums overflow */
+#define FLETCHER_WORDS 359
+
+static uint32_t fletcher_portable(uint32_t state, const unsigned char *p, size_t len)
+{
+  uint32_t sum1 = state & 0xffff, sum2 = state >> 16;
+  size_t words = len / 2, n;
+
+  while (words > 0) {
+    n = words < FLETCHER_WORDS ? words : FLETCHER_WORDS;
+    words -= n;
+    while (n-- > 0) {
+      sum1 += (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+      sum2 += sum1;
+      p += 2;
+    }
+    sum1 %= 65535;
+    sum2 %= 65535;
+  }
+  if (len & 1) {
+    sum1 = (sum1 + *p) % 65535;
+    sum2 = (sum2 + sum1) % 65535;
+  }
+  return (sum2 << 16) | sum1;
+}
+
+#if CHECKSUM_X86
+/* The vector kernels work on blocks of L words.  Over one block that
+   starts with sum1 = S, sum2 grows by L * S + sum((L - i) * w[i]), so
+   each lane keeps the plain word sums (s1), the weighted sums (s2) and
+   the running total of s1 at the start of every block (ps).  With
+   FLETCHER_BLOCKS blocks between reductions no 32 bit lane overflows. */
+#define FLETCHER_BLOCKS 128
+
+static uint32_t fletcher_reduce(uint32_t state, uint64_t blocks, uint64_t words,
+                                uint64_t s1, uint64_t ps, uint64_t s2)
+{
+  uint64_t sum1 = state & 0xffff, sum2 = state >> 16;
+
+  sum2 = (sum2 + (blocks * words % 65535) * sum1 + words * (ps % 65535) + s2) % 65535;
+  sum1 = (sum1 + s1) % 65535;
+  return (uint32_t)((sum2 << 16) | sum1);
+}
+
+TARGET("sse4.2")
+static uint32_t fletcher_sse42(uint32_t state, const unsigned char *p, size_t len)
+{
+  const __m128i wlo = _mm_setr_epi32(8, 7, 6, 5);
+  const __m128i whi = _mm_setr_epi32(4, 3, 2, 1);
+  __m128i s1, s2, ps, v, lo, hi;
+  uint32_t a[4], b[4], c[4];
+  size_t n;
+
+  while (len >= 16) {
+    s1 = s2 = ps = _mm_setzero_si128();
+    for (n=0; n<FLETCHER_BLOCKS && len>=16; n++, p+=16, len-=16) {
+      v = _mm_loadu_si128((const __m128i *)p);
+      lo = _mm_cvtepu16_epi32(v);
+      hi = _mm_cvtepu16_epi32(_mm_srli_si128(v, 8));
+      ps = _mm_add_epi32(ps, s1);
+      s1 = _mm_add_epi32(s1, _mm_add_epi32(lo, hi));
+      s2 = _mm_add_epi32(s2, _mm_add_epi32(_mm_mullo_epi32(lo, wlo), _mm_mullo_epi32(hi, whi)));
+    }
+    _mm_storeu_si128((__m128i *)a, s1);
+    _mm_storeu_si128((__m128i *)b, ps);
+    _mm_storeu_si128((__m128i *)c, s2);
+    state = fletcher_reduce(state, n, 8,
+                            (uint64_t)a[0] + a[1] + a[2] + a[3],
+                            (uint64_t)b[0] + b[1] + b[2] + b[3],
+                            (uint64_t)c[0] + c[1] + c[2] + c[3]);
+  }
+  return fletcher_portable(state, p, len);
+}
+
+TARGET("avx2")
+static uint32_t fletcher_avx2(uint32_t state, const unsigned char *p, size_t len)
+{
+  const __m256i wlo = _mm256_setr_epi32(16, 15, 14, 13, 12, 11, 10, 9);
+  const __m256i whi = _mm256_setr_epi32(8, 7, 6, 5, 4, 3, 2, 1);
+  __m256i s1, s2, ps, v, lo, hi;
+  uint32_t a[8], b[8], c[8];
+  uint64_t x, y, z;
+  size_t n;
+  int i;
+
+  while (len >= 32) {
+    s1 = s2 = ps = _mm256_setzero_si256();
+    for (n=0; n<FLETCHER_BLOCKS && len>=32; n++, p+=32, len-=32) {
+      v = _mm256_loadu_si256((const __m256i *)p);
+      lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+      hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+      ps = _mm256_add_epi32(ps, s1);
+      s1 = _mm256_add_epi32(s1, _mm256_add_epi32(lo, hi));
+      s2 = _mm256_add_epi32(s2, _mm256_add_epi32(_mm256_mullo_epi32(lo, wlo), _mm256_mullo_epi32(hi, whi)));
+    }
+    _mm256_storeu_si256((__m256i *)a, s1);
+    _mm256_storeu_si256((__m256i *)b, ps);
+    _mm256_storeu_si256((__m256i *)c, s2);
+    for (x=y=z=0, i=0; i<8; i++) {
+      x += a[i];
+      y += b[i];
+      z += c[i];
+    }
+    state = fletcher_reduce(state, n, 16, x, y, z);
+  }
+  return fletcher_sse42(state, p, len);
+}
+#endif
+
+/********* CRC-32C (Castagnoli) ************/
+
+/* the state is the reflected CRC register, inverted before and after */
+
+#define CRC32C_POLY 0x82f63b78u
+#define CRC32C_INIT 0xffffffffu
+
+static uint32_t crc32c_table[8][256];   /* slicing-by-8 tables */
+static int crc32c_ready = 0;
+
+static void crc32c_init_tables(void)
+{
+  uint32_t crc;
+  int i, j;
+
+  for (i=0; i<256; i++) {
+    crc = i;
+    for (j=0; j<8; j++)
+      crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+    crc32c_table[0][i] = crc;
+  }
+  for (i=0; i<256; i++)
+    for (j=1; j<8; j++)
+      crc32c_table[j][i] = (crc32c_table[j-1][i] >> 8) ^ crc32c_table[0][crc32c_table[j-1][i] & 0xff];
+  crc32c_ready = 1;
+}
+
+static uint32_t crc32c_portable(uint32_t crc, const unsigned char *p, size_t len)
+{
+  uint32_t lo, hi;
+
+  if (!crc32c_ready)
+    crc32c_init_tables();
+  while (len >= 8) {
+    lo = crc ^ ((uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+    hi = (uint32_t)p[4] | (uint32_t)p[5] << 8 | (uint32_t)p[6] << 16 | (uint32_t)p[7] << 24;
+    crc = crc32c_table[7][lo & 0xff] ^ crc32c_table[6][(lo >> 8) & 0xff] ^
+          crc32c_table[5][(lo >> 16) & 0xff] ^ crc32c_table[4][lo >> 24] ^
+          crc32c_table[3][hi & 0xff] ^ crc32c_table[2][(hi >> 8) & 0xff] ^
+          crc32c_table[1][(hi >> 16) & 0xff] ^ crc32c_table[0][hi >> 24];
+    p += 8;
+    len -= 8;
+  }
+  while (len-- > 0)
+    crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p++) & 0xff];
+  return crc;
+}
+
+static uint32_t crc32c_final(uint32_t crc)
+{
+  return crc ^ 0xffffffffu;
+}
+
+#if CHECKSUM_X86
+/* The crc32 instruction has a latency of three cycles but can start one
+   every cycle, so long buffers are split into three streams whose CRCs
+   are combined by shifting them over the bytes that follow (multiplying
+   by x^(8n) modulo the polynomial, as zlib's crc32_combine() does). */
+#define CRC32C_STREAM 256
+
+static uint32_t crc32c_shift1, crc32c_shift2;  /* x^(8*STREAM), x^(16*STREAM) mod P */
+
+static uint32_t multmodp(uint32_t a, uint32_t b)
+{
+  uint32_t m = (uint32_t)1 << 31, p = 0;
+
+  for (;;) {
+    if (a & m) {
+      p ^= b;
+      if ((a & (m - 1)) == 0)
+        break;
+    }
+    m >>= 1;
+    b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+  }
+  return p;
+}
+
+/* x^(8n) modulo the polynomial */
+static uint32_t xpow8n(size_t n)
+{
+  uint32_t p = (uint32_t)1 << 31;      /* x^0 */
+  uint32_t x2k = (uint32_t)1 << 23;    /* x^8, squared for every bit of n */
+
+  while (n) {
+    if (n & 1)
+      p = multmodp(x2k, p);
+    x2k = multmodp(x2k, x2k);
+    n >>= 1;
+  }
+  return p;
+}
+
+TARGET("sse4.2")
+static uint32_t crc32c_sse42(uint32_t crc, const unsigned char *p, size_t len)
+{
+  uint64_t c0, c1, c2, w;
+  size_t i;
+
+  if (crc32c_shift1 == 0) {
+    crc32c_shift2 = xpow8n(2 * CRC32C_STREAM);
+    crc32c_shift1 = xpow8n(CRC32C_STREAM);
+  }
+
+  while (len >= 3 * CRC32C_STREAM) {
+    c0 = crc;
+    c1 = c2 = 0;
+    for (i=0; i<CRC32C_STREAM; i+=8) {
+      memcpy(&w, p + i, 8);
+      c0 = _mm_crc32_u64(c0, w);
+      memcpy(&w, p + CRC32C_STREAM + i, 8);
+      c1 = _mm_crc32_u64(c1, w);
+      memcpy(&w, p + 2 * CRC32C_STREAM + i, 8);
+      c2 = _mm_crc32_u64(c2, w);
+    }
+    crc = multmodp(crc32c_shift2, (uint32_t)c0) ^ multmodp(crc32c_shift1, (uint32_t)c1) ^ (uint32_t)c2;
+    p += 3 * CRC32C_STREAM;
+    len -= 3 * CRC32C_STREAM;
+  }
+
+  c0 = crc;
+  while (len >= 8) {
+    memcpy(&w, p, 8);
+    c0 = _mm_crc32_u64(c0, w);
+    p += 8;
+    len -= 8;
+  }
+  crc = (uint32_t)c0;
+  while (len-- > 0)
+    crc = _mm_crc32_u8(crc, *p++);
+  return crc;
+}
+#endif
+
+/********* algorithm and kernel selection ************/
+
+static uint32_t no_final(uint32_t state)
+{
+  return state;
+}
+
+struct algorithm {
+  const char *name;
+  uint32_t init;
+  uint32_t (*final)(uint32_t);
+  update_fn update[KERNEL_NKERNELS];   /* NULL where there is no such kernel */
+};
+
+static const struct algorithm algorithms[CHECKSUM_NALGS] = {
+  { "sum", 0, no_final, { sum_portable, NULL, NULL } },
+#if CHECKSUM_X86
+  { "internet", 0, internet_final, { internet_portable, internet_sse42, internet_avx2 } },
+  { "fletcher32", FLETCHER_INIT, no_final, { fletcher_portable, fletcher_sse42, fletcher_avx2 } },
+  /* there is no wider CRC instruction, so AVX2 machines use the SSE4.2 kernel */
+  { "crc32c", CRC32C_INIT, crc32c_final, { crc32c_portable, crc32c_sse42, crc32c_sse42 } }
+#else
+  { "internet", 0, internet_final, { internet_portable, NULL, NULL } },
+  { "fletcher32", FLETCHER_INIT, no_final, { fletcher_portable, NULL, NULL } },
+  { "crc32c", CRC32C_INIT, crc32c_final, { crc32c_portable, NULL, NULL } }
+#endif
+};
+
+static const char *kernel_names[KERNEL_NKERNELS] = { "portable", "sse4.2", "avx2" };
+
+static enum checksum_alg selected = CHECKSUM_CRC32C;
+static enum checksum_kernel maxkernel = KERNEL_AVX2;  /* the best kernel checksum_isa() allows */
+static update_fn update = NULL;                       /* kernel used by checksum_packet() */
+
+const char *checksum_name(enum checksum_alg alg)
+{
+  return algorithms[alg].name;
+}
+
+const char *checksum_kernel_name(enum checksum_kernel kernel)
+{
+  return kernel_names[kernel];
+}
+
+int checksum_kernel_supported(enum checksum_kernel kernel)
+{
+#if CHECKSUM_X86
+  __builtin_cpu_init();
+  if (kernel == KERNEL_AVX2)
+    return __builtin_cpu_supports("avx2");
+  if (kernel == KERNEL_SSE42)
+    return __builtin_cpu_supports("sse4.2");
+#endif
+  return kernel == KERNEL_PORTABLE;
+}
+
+/* the best kernel for alg that the CPU and checksum_isa() allow */
+static update_fn best_kernel(enum checksum_alg alg)
+{
+  int k;
+
+  for (k=maxkernel; k>KERNEL_PORTABLE; k--)
+    if (algorithms[alg].update[k] != NULL && checksum_kernel_supported(k))
+      return algorithms[alg].update[k];
+  return algorithms[alg].update[KERNEL_PORTABLE];
+}
+
+/* select the algorithm used for packets by name, returns 0 if there is no such algorithm */
+int checksum_select(const char *name)
+{
+  int i;
+
+  for (i=0; i<CHECKSUM_NALGS; i++)
+    if (strcmp(name, algorithms[i].name) == 0) {
+      selected = i;
+      update = best_kernel(selected);
+      /* build the tables now rather than on first use, which may be on
+         any of the parallel engine's threads */
+      if (!crc32c_ready)
+        crc32c_init_tables();
+      return 1;
+    }
+  printf("Warning: unknown checksum %s, using %s\n", name, algorithms[selected].name);
+  return 0;
+}
+
+/* limit the kernels to the given instruction set, returns 0 if the name is unknown */
+int checksum_isa(const char *name)
+{
+  int k;
+
+  if (strcmp(name, "auto") == 0)
+    k = KERNEL_AVX2;
+  else
+    for (k=KERNEL_NKERNELS-1; k>=0 && strcmp(name, kernel_names[k]) != 0; k--)
+      ;
+  if (k < 0) {
+    printf("Warning: unknown checksum instruction set %s\n", name);
+    return 0;
+  }
+  maxkernel = k;
+  update = best_kernel(selected);
+  return 1;
+}
+
+uint32_t checksum_buffer(enum checksum_alg alg, enum checksum_kernel kernel, const void *data, size_t len)
+{
+  update_fn fn = algorithms[alg].update[kernel];
+
+  if (fn == NULL)
+    fn = algorithms[alg].update[KERNEL_PORTABLE];
+  return algorithms[alg].final(fn(algorithms[alg].init, data, len));
+}
+
+int checksum_packet(const struct pkt *packet)
+{
+  const struct algorithm *alg = &algorithms[selected];
+  uint32_t state;
+
+  if (selected == CHECKSUM_SUM)
+    return packet->seqnum + packet->acknum + packet->length +
+           (int)sum_portable(0, (const unsigned char *)packet->payload, packet->length);
+
+  if (update == NULL)
+    update = best_kernel(selected);
+
+  /* seqnum and acknum, then length and the payload that directly follows it */
+  state = update(alg->init, (const unsigned char *)&packet->seqnum, 2 * sizeof(int));
+  state = update(state, (const unsigned char *)&packet->length, sizeof(int) + packet->length);
+  return (int)alg->final(state);
+}
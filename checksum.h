@@ -0,0 +1,28 @@
+#include <stddef.h>
+#include <stdint.h>
+
+/* packet checksums.  The algorithm is chosen by name with checksum_select():
+     "sum"        the original byte sum of the header fields and payload
+     "internet"   the 16 bit one's complement Internet checksum (RFC 1071)
+     "fletcher32" Fletcher-32 over 16 bit words
+     "crc32c"     CRC-32C (Castagnoli), the default
+   Each algorithm has a portable kernel and, on x86, SSE4.2 and AVX2
+   kernels picked at run time from the CPU features.  checksum_isa()
+   restricts the kernels that may be used ("auto", "avx2", "sse4.2" or
+   "portable"). */
+
+enum checksum_alg { CHECKSUM_SUM, CHECKSUM_INTERNET, CHECKSUM_FLETCHER32, CHECKSUM_CRC32C, CHECKSUM_NALGS };
+enum checksum_kernel { KERNEL_PORTABLE, KERNEL_SSE42, KERNEL_AVX2, KERNEL_NKERNELS };
+
+extern int checksum_select(const char *name);
+extern int checksum_isa(const char *name);
+extern const char *checksum_name(enum checksum_alg alg);
+extern const char *checksum_kernel_name(enum checksum_kernel kernel);
+extern int checksum_kernel_supported(enum checksum_kernel kernel);
+
+/* checksum of len bytes at data with the given algorithm and kernel */
+extern uint32_t checksum_buffer(enum checksum_alg alg, enum checksum_kernel kernel, const void *data, size_t len);
+
+/* checksum of a packet with the selected algorithm, the checksum field itself is not covered */
+struct pkt;
+extern int checksum_packet(const struct pkt *packet);
@@ -0,0 +1,94 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <time.h>
+#include "checksum.h"
+
+/* ******************************************************************
+   Checksum microbenchmark.  Checks that every vector kernel agrees
+   with the portable kernel, then reports the throughput of each
+   algorithm and kernel over a range of payload sizes.
+
+     gcc -std=c99 -O2 -o checksum_bench checksum_bench.c checksum.c
+     ./checksum_bench [bytes per size, default 64MB]
+**********************************************************************/
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* compare every kernel with the portable one over all short lengths and alignments */
+static int selftest(const unsigned char *buf)
+{
+  uint32_t want, got;
+  size_t len, off;
+  int alg, k, errors = 0;
+
+  for (alg=0; alg<CHECKSUM_NALGS; alg++)
+    for (k=KERNEL_SSE42; k<KERNEL_NKERNELS; k++) {
+      if (!checksum_kernel_supported(k))
+        continue;
+      for (len=0; len<=2100; len += len < 300 ? 1 : 97)
+        for (off=0; off<8; off++) {
+          want = checksum_buffer(alg, KERNEL_PORTABLE, buf + off, len);
+          got = checksum_buffer(alg, k, buf + off, len);
+          if (want != got) {
+            if (errors++ < 10)
+              printf("MISMATCH: %s %s length %d offset %d: %08x != %08x\n", checksum_name(alg),
+                     checksum_kernel_name(k), (int)len, (int)off, got, want);
+          }
+        }
+    }
+  return errors;
+}
+
+int main(int argc, char *argv[])
+{
+  static const size_t sizes[] = { 20, 36, 64, 256, 1460, 4096, 65536, 1 << 20 };
+  const int nsizes = sizeof(sizes) / sizeof(sizes[0]);
+  double total = argc > 1 ? atof(argv[1]) : 64.0 * (1 << 20);
+  unsigned char *buf;
+  volatile uint32_t sink = 0;
+  double start, elapsed;
+  long calls, i;
+  int alg, k, s;
+
+  buf = malloc((1 << 20) + 64);
+  if (buf == NULL) {
+    printf("memory allocation for buffer failed.");
+    exit(EXIT_FAILURE);
+  }
+  srand(9999);
+  for (i=0; i<(1 << 20) + 64; i++)
+    buf[i] = rand() & 0xff;
+
+  if (selftest(buf) != 0) {
+    printf("vector kernels do not match the portable kernels\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("%-10s %-8s %8s %10s %8s\n", "algorithm", "kernel", "bytes", "ns/call", "GB/s");
+  for (alg=0; alg<CHECKSUM_NALGS; alg++)
+    for (k=0; k<KERNEL_NKERNELS; k++) {
+      if (!checksum_kernel_supported(k))
+        continue;
+      /* sum has a portable kernel only */
+      if (k != KERNEL_PORTABLE && alg == CHECKSUM_SUM)
+        continue;
+      for (s=0; s<nsizes; s++) {
+        calls = (long)(total / sizes[s]) + 1;
+        start = now();
+        for (i=0; i<calls; i++)
+          sink += checksum_buffer(alg, k, buf + (i & 7), sizes[s]);
+        elapsed = now() - start;
+        printf("%-10s %-8s %8d %10.1f %8.2f\n", checksum_name(alg), checksum_kernel_name(k),
+               (int)sizes[s], elapsed * 1e9 / calls, (double)calls * sizes[s] / elapsed * 1e-9);
+      }
+    }
+  free(buf);
+  return sink == 0xdeadbeef ? EXIT_FAILURE : EXIT_SUCCESS;
+}
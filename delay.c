@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "emulator.h"
+#include "options.h"
+#include "delay.h"
+
+/* ******************************************************************
+   Channel delay distributions used by tolayer3().  Every sample takes
+   one number from the emulator's jimsrand() and transforms it, so the
+   default uniform model draws the same numbers as the original code.
+**********************************************************************/
+
+extern double jimsrand(void);   /* the emulator's random number generator */
+
+static enum delay_model model;
+static double dmin, dmax;       /* bounds of the uniform delay, scale of the others */
+static double dmean;            /* mean of the constant and exponential delays */
+static double alpha;            /* shape of the Pareto delay */
+static bool reorder;            /* packets may overtake each other */
+
+static double *cdfdelay;        /* empirical distribution: delays ... */
+static double *cdfprob;         /* ... and their cumulative probabilities */
+static int cdflen;
+
+/* read an empirical distribution, returns false if there is none in the file */
+static bool loadcdf(const char *path)
+{
+  FILE *fp;
+  double d, p;
+  int capacity = 0;
+
+  free(cdfdelay);
+  free(cdfprob);
+  cdfdelay = cdfprob = NULL;
+  cdflen = 0;
+
+  fp = fopen(path, "r");
+  if (fp == NULL)
+    return false;
+  while (fscanf(fp, "%lf %lf", &d, &p) == 2) {
+    if (cdflen == capacity) {
+      capacity = capacity ? 2 * capacity : 64;
+      cdfdelay = realloc(cdfdelay, capacity * sizeof(double));
+      cdfprob = realloc(cdfprob, capacity * sizeof(double));
+      if (cdfdelay == NULL || cdfprob == NULL) {
+        printf("memory allocation for delay distribution failed.");
+        exit(EXIT_FAILURE);
+      }
+    }
+    cdfdelay[cdflen] = d;
+    cdfprob[cdflen] = p;
+    cdflen++;
+  }
+  fclose(fp);
+  return cdflen > 0;
+}
+
+void delay_init(void)
+{
+  const char *name;
+
+  dmin = option_double("delay_min", 1.0);
+  dmax = option_double("delay_max", 10.0);
+  dmean = option_double("delay_mean", 5.5);
+  alpha = option_double("delay_alpha", 1.5);
+  reorder = option_int("reorder", 0) != 0;
+
+  name = option_string("delay", "uniform");
+  if (strcmp(name, "constant") == 0)
+    model = DELAY_CONSTANT;
+  else if (strcmp(name, "exponential") == 0)
+    model = DELAY_EXPONENTIAL;
+  else if (strcmp(name, "pareto") == 0)
+    model = DELAY_PARETO;
+  else if (strcmp(name, "empirical") == 0) {
+    model = DELAY_EMPIRICAL;
+    if (!loadcdf(option_string("delaycdf", "delay.txt"))) {
+      printf("Warning: can not read delay distribution %s, using uniform\n",
+             option_string("delaycdf", "delay.txt"));
+      model = DELAY_UNIFORM;
+    }
+  }
+  else {
+    if (strcmp(name, "uniform") != 0)
+      printf("Warning: unknown delay model %s, using uniform\n", name);
+    model = DELAY_UNIFORM;
+  }
+}
+
+bool delay_reorder(void)
+{
+  return reorder;
+}
+
+double delay_lookahead(void)
+{
+  switch (model) {
+  case DELAY_CONSTANT:
+    return dmean;
+  case DELAY_EMPIRICAL:
+    return cdfdelay[0];
+  case DELAY_UNIFORM:
+    return dmin < dmax ? dmin : dmax;
+  default:
+    return dmin;
+  }
+}
+
+/* invert the empirical distribution at u, interpolating between its points */
+static double empirical(double u)
+{
+  int lo = 0, hi = cdflen - 1, mid;
+
+  if (u <= cdfprob[0])
+    return cdfdelay[0];
+  if (u >= cdfprob[hi])
+    return cdfdelay[hi];
+  /* the first point with a probability of u or more */
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (cdfprob[mid] < u)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return cdfdelay[lo - 1] + (cdfdelay[lo] - cdfdelay[lo - 1]) *
+    (u - cdfprob[lo - 1]) / (cdfprob[lo] - cdfprob[lo - 1]);
+}
+
+double delay_sample(void)
+{
+  double u = jimsrand();
+  /* jimsrand() can return 1, which has no finite exponential or Pareto value */
+  double v = u < 1.0 ? 1.0 - u : 1e-9;
+
+  switch (model) {
+  case DELAY_CONSTANT:
+    return dmean;
+  case DELAY_EXPONENTIAL:
+    return dmin - dmean * log(v);
+  case DELAY_PARETO:
+    return dmin / pow(v, 1.0 / alpha);
+  case DELAY_EMPIRICAL:
+    return empirical(u);
+  case DELAY_UNIFORM:
+  default:
+    return dmin + (dmax - dmin) * u;
+  }
+}
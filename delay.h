@@ -0,0 +1,27 @@
+/* one-way channel delay, chosen with the delay option:
+     "uniform"      uniform on [delay_min, delay_max], by default [1, 10]
+                    as in the original emulator
+     "constant"     always delay_mean
+     "exponential"  delay_min plus an exponential with mean delay_mean
+     "pareto"       Pareto with scale delay_min and shape delay_alpha,
+                    heavy tailed for delay_alpha <= 2
+     "empirical"    drawn from the cumulative distribution in the file
+                    given by delaycdf, one "delay probability" pair per
+                    line with both increasing, the last probability 1
+   The delay is added to the arrival time of the last packet in flight in
+   the same direction, so the channel never reorders packets, unless the
+   reorder option is 1: then it is added to the current time and a packet
+   can overtake the ones sent before it. */
+
+enum delay_model { DELAY_UNIFORM, DELAY_CONSTANT, DELAY_EXPONENTIAL, DELAY_PARETO, DELAY_EMPIRICAL };
+
+extern void delay_init(void);
+
+/* the delay of the next packet */
+extern double delay_sample(void);
+
+/* packets may overtake each other */
+extern bool delay_reorder(void);
+
+/* the smallest delay the model can give */
+extern double delay_lookahead(void);
@@ -1,478 +1,1701 @@
-/* ***** THIS FILE SHOULD NOT BE MODIFIED ****************************
-   THERE IS NOT REASON THAT ANY STUDENT SHOULD HAVE TO READ OR UNDERSTAND
-   THE CODE BELOW.  YOU SHOLD NOT TOUCH, OR REFERENCE (in your code) ANY
-   OF THE DATA STRUCTURES BELOW.  If you're interested in how I designed
-   the emulator, you're welcome to look at the code - but again, you should have
-   to, and you defeinitely should not have to modify
-   This file contains the code that emulates the network.  It does not
-   implement any of the Go-Back-N protocol.
-   ********************************************************************
-
-   ******************************************************************
-   ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.1  J.F.Kurose
-   The code below emulates the layer 3 and below network environment:
-   - emulates the tranmission and delivery (possibly with bit-level corruption
-   and packet loss) of packets across the layer 3/4 interface
-   - handles the starting/stopping of a timer, and generates timer
-   interrupts (resulting in calling students timer handler).
-   - generates message to be sent (passed from later 5 to 4)
-
-   Network properties:
-   - one way network delay averages five time units (longer if there
-   are other messages in the channel for GBN), but can be larger
-   - packets can be corrupted (either the header or the data portion)
-   or lost, according to user-defined probabilities
-   - packets will be delivered in the order in which they were sent
-   (although some can be lost).
-
-   Modifications (6/6/2008 - CLP): 
-   - removed bidirectional GBN code and other code not used by prac. 
-   - removed hard coded maximum random number, use library defined
-   RAND_MAX value 
-   - simulator stops when no events are left rather than stopping as
-   soon as n packets are sent.
-   - fixed C style to adhere to current programming style
-
-   ********************************************************************* */
-#include <stdlib.h>
-#include <stdio.h>
-#include "emulator.h"
-#include "gbn.h"
-
-struct event {
-  float evtime;           /* event time */
-  int evtype;             /* event type code */
-  int eventity;           /* entity where event occurs */
-  struct pkt *pktptr;     /* ptr to packet (if any) assoc w/ this event */
-  struct event *prev;
-  struct event *next;
-};
-
-struct event *evlist = NULL;   /* the event list */
-
-/* possible events: */
-#define  TIMER_INTERRUPT 0  
-#define  FROM_LAYER5     1
-#define  FROM_LAYER3     2
-
-#define  OFF             0
-#define  ON              1
-
-int TRACE = 3;
-
-/* statistics updated by GBN */
-int window_full;   /* count of the number of messages dropped due to full window */
-int total_ACKs_received;
-int packets_resent;       /* count of the number of packets resent  */
-int new_ACKs;           /* count of the number of acks correctly received */
-int packets_received;  /* count of the packets received by receiver */
-
-/* statistics updated by emulator */
-static int packets_lost;  
-static int packets_corrupt;
-static int packets_sent;
-static int packets_timeout;
-static int messages_delivered;
-
-static int nsim = 0;              /* number of messages from 5 to 4 so far */ 
-static int nsimmax = 0;           /* number of msgs to generate, then stop */
-static float time = 0.000;
-static float lossprob;            /* probability that a packet is dropped  */
-static float corruptprob;   /* probability that one bit is packet is flipped */
-static int corruptdirection; /* A->B A<-B or bidirectional corruption/loss */
-static float lambda;        /* arrival rate of messages from layer 5 */   
-static int   ntolayer3;           /* number sent into layer 3 */
-static int   nlost;               /* number lost in media */
-static int ncorrupt;              /* number corrupted by media*/
-
-/****************************************************************************/
-/* jimsrand(): return a double in range [0,1].  The routine below is used to */
-/* isolate all random number generation in one location.  We assume that the*/
-/* system-supplied rand() function return an int in therange [0,mmm]        */
-/****************************************************************************/
-double jimsrand(void) 
-{
-  double mmm = RAND_MAX;     /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
-  double x;                   
-  x = rand()/mmm;            /* x should be uniform in [0,1] */
-  if (TRACE > 3)
-    printf("RANDOM NUMBER GENERAION CALLED: %f\n", x);
-  return(x);
-}  
-
-/********************* EVENT HANDLINE ROUTINES *******/
-/*  The next set of routines handle the event list   */
-/*****************************************************/
-
-void insertevent(struct event *p)
-{
-  struct event *q,*qold;
-
-  if (TRACE>2) {
-    printf("            INSERTEVENT: time is %f\n",time);
-    printf("            INSERTEVENT: future time will be %f\n",p->evtime); 
-  }
-  q = evlist;     /* q points to front of list in which p struct inserted */
-  if (q==NULL) {   /* list is empty */
-    evlist=p;
-    p->next=NULL;
-    p->prev=NULL;
-  }
-  else {
-    for (qold = q; q !=NULL && p->evtime > q->evtime; q=q->next)
-      qold=q; 
-    if (q==NULL) {   /* end of list */
-      qold->next = p;
-      p->prev = qold;
-      p->next = NULL;
-    }
-    else if (q==evlist) { /* front of list */
-      p->next=evlist;
-      p->prev=NULL;
-      p->next->prev=p;
-      evlist = p;
-    }
-    else {     /* middle of list */
-      p->next=q;
-      p->prev=q->prev;
-      q->prev->next=p;
-      q->prev=p;
-    }
-  }
-}
-
-void generate_next_arrival(void)
-{
-  double x;
-  struct event *evptr;
-
-  if (TRACE>2)
-    printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
- 
-  x = lambda*jimsrand()*2;  /* x is uniform on [0,2*lambda] */
-  /* having mean of lambda        */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  evptr->evtime =  time + x;
-  evptr->evtype =  FROM_LAYER5;
-  if (BIDIRECTIONAL && (jimsrand()>0.5) )
-    evptr->eventity = B;
-  else
-    evptr->eventity = A;
-  insertevent(evptr);
-} 
-
-void printevlist(void)
-{
-  struct event *q;
-  printf("--------------\nEvent List Follows:\n");
-  for(q = evlist; q!=NULL; q=q->next) {
-    printf("Event time: %f, type: %d entity: %d\n",q->evtime,q->evtype,q->eventity);
-  }
-  printf("--------------\n");
-}
-
-void init(void)                         /* initialize the simulator */
-{
-  float sum, avg;
-  int i;
-
-  printf("-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
-  printf("Enter the number of messages to simulate: ");
-  scanf("%d",&nsimmax);
-  printf("Enter  packet loss probability [enter 0.0 for no loss]:");
-  scanf("%f",&lossprob);
-  printf("Enter packet corruption probability [0.0 for no corruption]:");
-  scanf("%f",&corruptprob);
-  if (lossprob != 0.0 || corruptprob != 0.0) {
-    printf("If you want loss or corruption to only occur in one direction, choose the direction: 0 A->B, 1 A<-B, 2 A<->B (both directions) :");
-    scanf("%d",&corruptdirection);
-  }
-  printf("Enter average time between messages from sender's layer5 [ > 0.0]:");
-  scanf("%f",&lambda);
-  printf("Enter TRACE:");
-  scanf("%d",&TRACE);
-
-
-  srand(9999);              /* init random number generator */
-  sum = 0.0;                /* test random number generator for students */
-  for (i=0; i<1000; i++)
-    sum+=jimsrand();    /* jimsrand() should be uniform in [0,1] */
-  avg = sum/1000.0;
-  if (avg < 0.25 || avg > 0.75) {
-    printf("It is likely that random number generation on your machine\n" ); 
-    printf("is different from what this emulator expects.  Please take\n");
-    printf("a look at the routine jimsrand() in the emulator code. Sorry. \n");
-    exit(EXIT_FAILURE);
-  }
-
-  /* initialise statistics */
-  window_full = 0;
-  total_ACKs_received = 0;
-  packets_resent = 0;
-  new_ACKs = 0;
-  packets_received = 0;
-  packets_lost = 0;  
-  packets_corrupt = 0;
-  packets_sent = 0;
-  packets_timeout = 0;
-  messages_delivered = 0;
-
-  ntolayer3 = 0;
-  nlost = 0;
-  ncorrupt = 0;
-
-  time=0.0;                    /* initialize time to 0.0 */
-  generate_next_arrival();     /* initialize event list */
-}
-
-/********************** Student-callable ROUTINES ***********************/
-
-/* called by students routine to cancel a previously-started timer */
-void stoptimer(int AorB)
-/* A or B is trying to stop timer */
-{
-  struct event *q;
-
-  if (TRACE>1)
-    printf("          STOP TIMER: stopping timer at %f\n",time);
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-  for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
-      /* remove this event */
-      if (q->next==NULL && q->prev==NULL)
-        evlist=NULL;         /* remove first and only event on list */
-      else if (q->next==NULL) /* end of list - there is one in front */
-        q->prev->next = NULL;
-      else if (q==evlist) { /* front of list - there must be event after */
-        q->next->prev=NULL;
-        evlist = q->next;
-      }
-      else {     /* middle of list */
-        q->next->prev = q->prev;
-        q->prev->next =  q->next;
-      }
-      free(q);
-      return;
-    }
-  printf("Warning: unable to cancel your timer. It wasn't running.\n");
-}
-
-
-void starttimer(int AorB, double increment)
-/* A or B is trying to start timer */
-{
-
-  struct event *q;
-  struct event *evptr;
-
-  if (TRACE>1)
-    printf("          START TIMER: starting timer at %f\n",time);
-  /* be nice: check to see if timer is already started, if so, then  warn */
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next)  */
-  for (q=evlist; q!=NULL ; q = q->next)  
-    if ( (q->evtype==TIMER_INTERRUPT  && q->eventity==AorB) ) { 
-      printf("Warning: attempt to start a timer that is already started\n");
-      return;
-    }
- 
-  /* create future event for when timer goes off */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  evptr->evtime =  time + increment;
-  evptr->evtype =  TIMER_INTERRUPT;
-   
- 
-  evptr->eventity = AorB;
-  insertevent(evptr);
-} 
-
-
-/************************** TOLAYER3 ***************/
-void tolayer3(int AorB, struct pkt packet)
-/* A or B is sending to network  */
-{
-  struct pkt *mypktptr;
-  struct event *evptr,*q;
-  float lastime, x;
-  int i;
-
-  ntolayer3++;
-
-  /* simulate losses: */
-  if (jimsrand() < lossprob && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
-    nlost++;
-    if (TRACE>0)    
-      printf("          TOLAYER3: packet being lost\n");
-    return;
-  }  
-
-  /* make a copy of the packet student just gave me since he/she may decide */
-  /* to do something with the packet after we return back to him/her */ 
-  mypktptr = malloc(sizeof(struct pkt));
-  if (mypktptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  mypktptr->seqnum = packet.seqnum;
-  mypktptr->acknum = packet.acknum;
-  mypktptr->checksum = packet.checksum;
-  for (i=0; i<20; i++)
-    mypktptr->payload[i] = packet.payload[i];
-  if (TRACE>2)  {
-    printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
-           mypktptr->acknum,  mypktptr->checksum);
-    for (i=0; i<20; i++)
-      printf("%c",mypktptr->payload[i]);
-    printf("\n");
-  }
-
-  /* create future event for arrival of packet at the other side */
-  evptr = malloc(sizeof(struct event));
-  if (evptr == 0) {
-    printf("memory allocation for event failed.");
-    exit(EXIT_FAILURE);
-  }
-  evptr->evtype =  FROM_LAYER3;   /* packet will pop out from layer3 */
-  evptr->eventity = (AorB+1) % 2; /* event occurs at other entity */
-  evptr->pktptr = mypktptr;       /* save ptr to my copy of packet */
-  /* finally, compute the arrival time of packet at the other end.
-     medium can not reorder, so make sure packet arrives between 1 and 10
-     time units after the latest arrival time of packets
-     currently in the medium on their way to the destination */
-  lastime = time;
-  /* for (q=evlist; q!=NULL && q->next!=NULL; q = q->next) */
-  for (q=evlist; q!=NULL ; q = q->next) 
-    if ( (q->evtype==FROM_LAYER3  && q->eventity==evptr->eventity) ) 
-      lastime = q->evtime;
-  evptr->evtime =  lastime + 1 + 9*jimsrand();
- 
-
-
-  /* simulate corruption: */
-  if ((jimsrand() < corruptprob)  && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
-    ncorrupt++;
-    if ( (x = jimsrand()) < .75)
-      mypktptr->payload[0]='Z';   /* corrupt payload */
-    else if (x < .875)
-      mypktptr->seqnum = 999999;
-    else
-      mypktptr->acknum = 999999;
-    if (TRACE>0)    
-      printf("          TOLAYER3: packet being corrupted\n");
-  }  
-
-  if (TRACE>2)  
-    printf("          TOLAYER3: scheduling arrival on other side\n");
-  insertevent(evptr);
-} 
-
-void tolayer5(int AorB, char datasent[20])
-{
-  int i;  
-  if (TRACE>2) {
-    printf("          TOLAYER5: data received by application at ");
-    if (AorB == A) 
-      printf("A: ");
-    else
-      printf("B: ");
-    for (i=0; i<20; i++)  
-      printf("%c",datasent[i]);
-    printf("\n");
-  }
-  messages_delivered++;
-}
-
-int main(void)
-{
-  struct event *eventptr;
-  struct msg  msg2give;
-  struct pkt  pkt2give;
-   
-  int i,j;
-  
-  init();
-  A_init();
-  B_init();
-   
-  while (1) {
-    eventptr = evlist;            /* get next event to simulate */
-    if (eventptr==NULL)
-      goto terminate;
-    evlist = evlist->next;        /* remove this event from event list */
-    if (evlist!=NULL)
-      evlist->prev=NULL;
-    if (TRACE>=2) {
-      printf("\nEVENT time: %f,",eventptr->evtime);
-      printf("  type: %d",eventptr->evtype);
-      if (eventptr->evtype==0)
-        printf(", timerinterrupt  ");
-      else if (eventptr->evtype==1)
-        printf(", fromlayer5 ");
-      else
-        printf(", fromlayer3 ");
-      printf(" entity: %d\n",eventptr->eventity);
-    }
-    time = eventptr->evtime;        /* update time to next event time */
-    if (eventptr->evtype == FROM_LAYER5 ) {
-      if (nsim < nsimmax) {
-        generate_next_arrival();   /* set up future arrival */
-        /* fill in msg to give with string of same letter */    
-        j = nsim % 26; 
-        for (i=0; i<20; i++)  
-          msg2give.data[i] = 97 + j;
-        if (TRACE>2) {
-          printf("          MAINLOOP: data given to student: ");
-          for (i=0; i<20; i++) 
-            printf("%c", msg2give.data[i]);
-          printf("\n");
-        }
-        nsim++;
-        if (eventptr->eventity == A) 
-          A_output(msg2give);  
-        else
-          B_output(msg2give);  
-      }
-      else if (TRACE > 2)
-          printf("          FROM_LAYER5: no more messages to send: \n");
-    }
-    else if (eventptr->evtype ==  FROM_LAYER3) {
-      pkt2give.seqnum = eventptr->pktptr->seqnum;
-      pkt2give.acknum = eventptr->pktptr->acknum;
-      pkt2give.checksum = eventptr->pktptr->checksum;
-      for (i=0; i<20; i++)  
-        pkt2give.payload[i] = eventptr->pktptr->payload[i];
-	    if (eventptr->eventity ==A)      /* deliver packet by calling */
-        A_input(pkt2give);            /* appropriate entity */
-      else
-        B_input(pkt2give);
-	    free(eventptr->pktptr);          /* free the memory for packet */
-    }
-    else if (eventptr->evtype ==  TIMER_INTERRUPT) {
-      if (eventptr->eventity == A) 
-        A_timerinterrupt();
-      else
-        B_timerinterrupt();
-    }
-    else  {
-      printf("INTERNAL PANIC: unknown event type \n");
-    }
-    free(eventptr);
-  }
-
- terminate:
-  printf(" Simulator terminated at time %f\n after attempting to send %d msgs from layer5\n",time,nsim);
-  printf("number of messages dropped due to full window:  %d \n", window_full);
-  printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", new_ACKs);
-  printf("(note: a single acknowledgement may have acknowledged more than one packet - if cumulative acknowledgements are used)\n");
-  printf("number of packet resends by A:  %d \n", packets_resent);
-  printf("number of correct packets received at B:  %d \n", packets_received);
-  printf("number of messages delivered to application:  %d \n", messages_delivered);
-  return EXIT_SUCCESS;
+/* ***** THIS FILE SHOULD NOT BE MODIFIED ****************************
+   THERE IS NOT REASON THAT ANY STUDENT SHOULD HAVE TO READ OR UNDERSTAND
+   THE CODE BELOW.  YOU SHOLD NOT TOUCH, OR REFERENCE (in your code) ANY
+   OF THE DATA STRUCTURES BELOW.  If you're interested in how I designed
+   the emulator, you're welcome to look at the code - but again, you should have
+   to, and you defeinitely should not have to modify
+   This file contains the code that emulates the network.  It does not
+   implement any of the Go-Back-N protocol.
+   ********************************************************************
+
+   ******************************************************************
+   ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.1  J.F.Kurose
+   The code below emulates the layer 3 and below network environment:
+   - emulates the tranmission and delivery (possibly with bit-level corruption
+   and packet loss) of packets across the layer 3/4 interface
+   - handles the starting/stopping of a timer, and generates timer
+   interrupts (resulting in calling students timer handler).
+   - generates message to be sent (passed from later 5 to 4)
+
+   Network properties:
+   - one way network delay averages five time units (longer if there
+   are other messages in the channel for GBN), but can be larger
+   - packets can be corrupted (either the header or the data portion)
+   or lost, according to user-defined probabilities
+   - packets will be delivered in the order in which they were sent
+   (although some can be lost).
+
+   Modifications (6/6/2008 - CLP): 
+   - removed bidirectional GBN code and other code not used by prac. 
+   - removed hard coded maximum random number, use library defined
+   RAND_MAX value 
+   - simulator stops when no events are left rather than stopping as
+   soon as n packets are sent.
+   - fixed C style to adhere to current programming style
+   - optional bottleneck link with a bit rate, a finite queue and
+   RED or CoDel, see link.h
+   - loss models: bernoulli, Gilbert-Elliott bursts or a loss trace,
+   see loss.h
+   - delay distributions and optional reordering, see delay.h
+   - many flows, each an A/B pair with its own protocol instance,
+   sharing the channel; the event list is a binary heap
+   - multi-hop topologies of routers with a queue on every link,
+   see topology.h
+   - a conservative parallel engine that runs groups of flows on
+   threads of their own, see PARALLEL ENGINE below
+   - snapshots of a running simulation, restored later or forked into
+   branches with other loss and corruption, see checkpoint.h
+   - record and replay of arrivals and channel choices, see replay.h
+
+   ********************************************************************* */
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "emulator.h"
+#include "gbn.h"
+#include "options.h"
+#include "link.h"
+#include "loss.h"
+#include "delay.h"
+#include "topology.h"
+#include "threads.h"
+#include "checkpoint.h"
+#include "replay.h"
+#include "filexfer.h"
+#include "realtime.h"
+#include "traffic.h"
+#include "results.h"
+#include "stats.h"
+
+struct event {
+  float evtime;           /* event time */
+  int evtype;             /* event type code */
+  int eventity;           /* entity where event occurs: 2 * flow + A or B */
+  struct pkt *pktptr;     /* ptr to packet (if any) assoc w/ this event */
+  unsigned long seq;      /* order of insertion, to break ties in evtime */
+  int heapidx;            /* position of the event in the event heap */
+  int hop;                /* links a packet has crossed, in a multi-hop topology */
+};
+
+/* the event list is kept as a binary heap ordered by time.  Events at the
+   same time come out newest first, which is the order the original sorted
+   list gave them. */
+static THREADLOCAL struct event **evheap = NULL;
+static THREADLOCAL int nevents = 0;
+static THREADLOCAL int maxevents = 0;
+static THREADLOCAL unsigned long evseq = 0;
+
+/* with streams, ties are broken by the kind of event before the order of
+   insertion: a flow's own events and packets going into the network
+   first, then packets arriving, then packets at routers.  The order then
+   does not depend on when an engine puts an event on the list. */
+#define SEQCLASS(c) ((unsigned long)(c) << (8 * sizeof(unsigned long) - 2))
+
+/* the eventlog option: every insert, pop and cancel of the event list is
+   written to this file, for the event list benchmark (eventq_bench.c) to
+   replay.  A cancel names the event by the number of inserts before it. */
+static FILE *evlog = NULL;
+
+/* each flow is an A/B pair of entities, entity 2 * flow + AorB */
+#define ENTITY(flow, AorB) (2 * (flow) + (AorB))
+#define FLOW(entity) ((entity) / 2)
+#define SIDE(entity) ((entity) % 2)
+
+/* possible events: */
+#define  TIMER_INTERRUPT 0  
+#define  FROM_LAYER5     1
+#define  FROM_LAYER3     2
+#define  FROM_ROUTER     3   /* packet reaches a router on its way */
+#define  TO_NETWORK      4   /* packet waits for the parallel engine's network phase */
+
+#define  OFF             0
+#define  ON              1
+
+int TRACE = 3;
+
+/* statistics updated by GBN */
+THREADLOCAL int window_full;   /* count of the number of messages dropped due to full window */
+THREADLOCAL int total_ACKs_received;
+THREADLOCAL int packets_resent;       /* count of the number of packets resent  */
+THREADLOCAL int new_ACKs;           /* count of the number of acks correctly received */
+THREADLOCAL int packets_received;  /* count of the packets received by receiver */
+THREADLOCAL int acks_sent;         /* count of the ACKs sent in packets of their own */
+THREADLOCAL int acks_piggybacked;  /* count of the ACKs carried by data packets */
+THREADLOCAL int packets_buffered;  /* count of the packets buffered because they arrived out of order */
+
+/* statistics updated by the send queue */
+THREADLOCAL int messages_queued;    /* count of the messages queued because the window was full */
+THREADLOCAL int sendqueue_maxdepth; /* the largest number of messages queued at one time */
+THREADLOCAL double sendqueue_delay; /* total time messages spent waiting in the send queue */
+
+/* statistics updated by emulator, more are counted in stats.h */
+static THREADLOCAL int messages_delivered;
+
+static THREADLOCAL int nsim = 0;  /* number of messages from 5 to 4 so far */ 
+static int nsimmax = 0;           /* number of msgs to generate, then stop */
+static THREADLOCAL float time = 0.000;
+static float lossprob;            /* probability that a packet is dropped  */
+static float corruptprob;   /* probability that one bit is packet is flipped */
+static int corruptdirection; /* A->B A<-B or bidirectional corruption/loss */
+static float lambda;        /* arrival rate of messages from layer 5 */   
+static int seed;            /* of the random number generator */
+static double bmix;         /* fraction of layer 5 messages that arrive at B */
+static THREADLOCAL int ntolayer3; /* number sent into layer 3 */
+static int   nlost;               /* number lost in media */
+static int ncorrupt;              /* number corrupted by media*/
+static int nreordered;            /* number overtaken by a later packet */
+static float lastarrival[2];      /* latest arrival time scheduled at the A/B side */
+static int backpressure;          /* honour layer5_backpressure() requests from A and B */
+static int saturate;              /* A always has a message ready, closed loop */
+static int warmup;                /* messages delivered before steady state is measured */
+static int eventlimit;            /* stop when the event lists hold more events than this */
+static bool collapsed;            /* the run was stopped for holding too many events */
+static THREADLOCAL int nheld;     /* number of arrivals held back */
+
+/* per-flow and per-entity state is kept in flat arrays, so that tens of
+   thousands of flows stay small */
+static int nflows = 1;            /* number of A/B pairs */
+static THREADLOCAL int curflow = 0; /* flow of the event being handled */
+static struct event **timers;     /* each entity's running timer, or NULL */
+static char *blocked;             /* layer 5 at an entity has been asked to hold back messages */
+static char *held;                /* an arrival at an entity is being held back */
+struct flowstats {
+  int generated;                  /* messages given to the flow by layer 5 */
+  int delivered;                  /* messages the flow delivered to layer 5 */
+  int packets;                    /* packets the flow sent into layer 3 */
+  double warmed;                  /* when the flow's share of the warm-up was delivered */
+  double lastdelivery;            /* when the flow last delivered a message */
+};
+static struct flowstats *flowstats;
+
+/* parallel engine */
+static int nthreads = 0;          /* worker threads, 0 runs the sequential engine */
+static bool flowstreams;          /* the flows and the network draw from streams, and the
+                                     flows have fixed shares of the messages */
+static unsigned long *streams;    /* random number streams: the network's, then one per flow */
+static THREADLOCAL unsigned long *rng; /* stream in use, NULL for rand() */
+static unsigned long ndraws;      /* numbers drawn from rand(), to restore its position */
+struct evarray {
+  struct event **ev;
+  int n, max;
+};
+struct counters {                 /* the statistics each thread keeps */
+  int window_full, total_ACKs_received, packets_resent, new_ACKs, packets_received;
+  int acks_sent, acks_piggybacked, packets_buffered, messages_queued, sendqueue_maxdepth;
+  double sendqueue_delay;
+  int messages_delivered, nsim, ntolayer3, nheld;
+};
+struct worker {
+  struct evarray outbox;          /* packets sent in this window, for the network */
+  struct evarray inbox;           /* packets arriving at the worker's flows */
+  float next;                     /* time of the worker's next event, -1 if none */
+  float last;                     /* time of the last event the worker handled */
+  int nevents;                    /* events on the worker's list after the window */
+  struct counters counters;       /* the worker's statistics when it finished */
+};
+static struct worker *workers;    /* flow f runs on workers[f % nthreads] */
+static struct evarray sent;       /* the packets sent in the window, in order, or
+                                     by the sequential engine at this time */
+static THREADLOCAL struct worker *self; /* the worker running on this thread */
+static struct stats *workerstats; /* each worker's counts when it finished */
+
+/****************************************************************************/
+/* jimsrand(): return a double in range [0,1].  The routine below is used to */
+/* isolate all random number generation in one location.  We assume that the*/
+/* system-supplied rand() function return an int in therange [0,mmm]        */
+/****************************************************************************/
+double jimsrand(void) 
+{
+  double mmm = RAND_MAX;     /* largest int  - MACHINE DEPENDENT!!!!!!!!   */
+  double x;                   
+
+  if (rng != NULL) {
+    /* the parallel engine gives every flow and the network a xorshift
+       stream of their own, so the numbers each draws do not depend on
+       how the flows are spread over the threads */
+    *rng ^= (*rng << 13) & 0xffffffffUL;
+    *rng ^= *rng >> 17;
+    *rng ^= (*rng << 5) & 0xffffffffUL;
+    x = *rng / 4294967295.0;
+  }
+  else {
+    x = rand()/mmm;            /* x should be uniform in [0,1] */
+    ndraws++;
+  }
+  if (TRACE > 3)
+    printf("RANDOM NUMBER GENERAION CALLED: %f\n", x);
+  return(x);
+}  
+
+/* the first state of random number stream i, spread out by a hash so that
+   neighbouring streams are unrelated */
+static unsigned long seedstream(int i)
+{
+  unsigned long x = ((unsigned long)seed + 0x9e3779b9UL * i) & 0xffffffffUL;
+
+  x = ((x ^ (x >> 16)) * 0x85ebca6bUL) & 0xffffffffUL;
+  x = ((x ^ (x >> 13)) * 0xc2b2ae35UL) & 0xffffffffUL;
+  x ^= x >> 16;
+  return x != 0 ? x : 1;
+}
+
+/********************* PACKET BUFFERS ***************/
+/*  Packets in flight live in buffers owned by the   */
+/*  emulator.  Delivered packets go back on a free   */
+/*  list, so the buffers are reused, not malloc'd.   */
+/*****************************************************/
+
+static THREADLOCAL struct pkt **freepkts = NULL;   /* stack of free packet buffers */
+static THREADLOCAL int nfreepkts = 0;
+static THREADLOCAL int maxfreepkts = 0;
+
+struct pkt *allocpkt(void)
+{
+  struct pkt *p;
+
+  if (nfreepkts > 0)
+    return freepkts[--nfreepkts];
+  p = malloc(sizeof(struct pkt));
+  if (p == 0) {
+    printf("memory allocation for packet failed.");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+void freepkt(struct pkt *p)
+{
+  if (nfreepkts == maxfreepkts) {
+    maxfreepkts = maxfreepkts ? 2 * maxfreepkts : 64;
+    freepkts = realloc(freepkts, maxfreepkts * sizeof(struct pkt *));
+    if (freepkts == 0) {
+      printf("memory allocation for packet buffers failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  freepkts[nfreepkts++] = p;
+}
+
+/********************* EVENT HANDLINE ROUTINES *******/
+/*  The next set of routines handle the event list   */
+/*****************************************************/
+
+/* does event p come out of the event list before event q? */
+static int evbefore(const struct event *p, const struct event *q)
+{
+  return p->evtime < q->evtime || (p->evtime == q->evtime && p->seq > q->seq);
+}
+
+static void evplace(struct event *p, int i)
+{
+  evheap[i] = p;
+  p->heapidx = i;
+}
+
+static void siftup(int i)
+{
+  struct event *p = evheap[i];
+
+  while (i > 0 && evbefore(p, evheap[(i - 1) / 2])) {
+    evplace(evheap[(i - 1) / 2], i);
+    i = (i - 1) / 2;
+  }
+  evplace(p, i);
+}
+
+static void siftdown(int i)
+{
+  struct event *p = evheap[i];
+  int child;
+
+  while ((child = 2 * i + 1) < nevents) {
+    if (child + 1 < nevents && evbefore(evheap[child + 1], evheap[child]))
+      child++;
+    if (!evbefore(evheap[child], p))
+      break;
+    evplace(evheap[child], i);
+    i = child;
+  }
+  evplace(p, i);
+}
+
+/* make room for one more event */
+static void evgrow(void)
+{
+  if (nevents == maxevents) {
+    maxevents = maxevents ? 2 * maxevents : 64;
+    evheap = realloc(evheap, maxevents * sizeof(struct event *));
+    if (evheap == 0) {
+      printf("memory allocation for event list failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+void insertevent(struct event *p)
+{
+  if (TRACE>2) {
+    printf("            INSERTEVENT: time is %f\n",time);
+    printf("            INSERTEVENT: future time will be %f\n",p->evtime); 
+  }
+  evgrow();
+  p->seq = evseq++;
+  if (evlog != NULL)
+    fprintf(evlog, "i %.9g\n", p->evtime);
+  if (flowstreams)
+    p->seq |= SEQCLASS(p->evtype == FROM_ROUTER ? 0 : p->evtype == FROM_LAYER3 ? 1 : 2);
+  evplace(p, nevents++);
+  siftup(nevents - 1);
+}
+
+/* take event p out of the event list */
+void removeevent(struct event *p)
+{
+  int i = p->heapidx;
+
+  nevents--;
+  if (i == nevents)
+    return;
+  evplace(evheap[nevents], i);
+  siftdown(i);
+  siftup(evheap[i]->heapidx);
+}
+
+/* remove and return the next event to simulate, or NULL if there is none */
+struct event *nextevent(void)
+{
+  struct event *p;
+
+  if (nevents == 0)
+    return NULL;
+  p = evheap[0];
+  removeevent(p);
+  if (evlog != NULL)
+    fputs("p\n", evlog);
+  return p;
+}
+
+/* schedule a message arrival from layer 5 at entity (2 * flow + A or B) at time evtime */
+void insertarrival(float evtime, int entity)
+{
+  struct event *evptr;
+
+  evptr = malloc(sizeof(struct event));
+  if (evptr == 0) {
+    printf("memory allocation for event failed.");
+    exit(EXIT_FAILURE);
+  }
+  evptr->evtime =  evtime;
+  evptr->evtype =  FROM_LAYER5;
+  evptr->eventity = entity;
+  insertevent(evptr);
+}
+
+void generate_next_arrival(int flow)
+{
+  struct arrivalchoice c;
+
+  if (TRACE>2)
+    printf("          GENERATE NEXT ARRIVAL: creating new arrival\n");
+ 
+  if (saturate) {
+    /* the next message is ready at once, and held while A is blocked */
+    c.interval = 0.0;
+    c.side = A;
+  }
+  else if (replay_arrival(flow, &c))
+    traffic_replayed(flow);
+  else
+    c.interval = traffic_next(flow, time, &c.side);
+  record_arrival(flow, &c);
+  insertarrival(time + c.interval, ENTITY(flow, c.side));
+} 
+
+void printevlist(void)
+{
+  struct event *q;
+  int i;
+  printf("--------------\nEvent List Follows:\n");
+  for(i = 0; i < nevents; i++) {
+    q = evheap[i];
+    printf("Event time: %f, type: %d entity: %d\n",q->evtime,q->evtype,q->eventity);
+  }
+  printf("--------------\n");
+}
+
+void init(void)                         /* initialize the simulator */
+{
+  FILE *prompts;
+  float sum, avg;
+  int i;
+
+  /* a results record on standard output is for a program to read, so the
+     questions go to standard error */
+  prompts = results_replace_summary() ? stderr : stdout;
+  fprintf(prompts, "-----  Stop and Wait Network Simulator Version 1.1 -------- \n\n");
+  fprintf(prompts, "Enter the number of messages to simulate: ");
+  scanf("%d",&nsimmax);
+  fprintf(prompts, "Enter  packet loss probability [enter 0.0 for no loss]:");
+  scanf("%f",&lossprob);
+  fprintf(prompts, "Enter packet corruption probability [0.0 for no corruption]:");
+  scanf("%f",&corruptprob);
+  if (lossprob != 0.0 || corruptprob != 0.0) {
+    fprintf(prompts, "If you want loss or corruption to only occur in one direction, choose the direction: 0 A->B, 1 A<-B, 2 A<->B (both directions) :");
+    scanf("%d",&corruptdirection);
+  }
+  fprintf(prompts, "Enter average time between messages from sender's layer5 [ > 0.0]:");
+  scanf("%f",&lambda);
+  fprintf(prompts, "Enter TRACE:");
+  scanf("%d",&TRACE);
+
+
+  seed = option_int("seed", 9999);
+  srand(seed);              /* init random number generator */
+  sum = 0.0;                /* test random number generator for students */
+  for (i=0; i<1000; i++)
+    sum+=jimsrand();    /* jimsrand() should be uniform in [0,1] */
+  avg = sum/1000.0;
+  if (avg < 0.25 || avg > 0.75) {
+    printf("It is likely that random number generation on your machine\n" ); 
+    printf("is different from what this emulator expects.  Please take\n");
+    printf("a look at the routine jimsrand() in the emulator code. Sorry. \n");
+    exit(EXIT_FAILURE);
+  }
+
+  /* initialise statistics */
+  window_full = 0;
+  total_ACKs_received = 0;
+  packets_resent = 0;
+  new_ACKs = 0;
+  packets_received = 0;
+  acks_sent = 0;
+  acks_piggybacked = 0;
+  packets_buffered = 0;
+  messages_queued = 0;
+  sendqueue_maxdepth = 0;
+  sendqueue_delay = 0.0;
+  messages_delivered = 0;
+
+  ntolayer3 = 0;
+  nlost = 0;
+  ncorrupt = 0;
+  nreordered = 0;
+  lastarrival[A] = lastarrival[B] = 0.0;
+
+  backpressure = option_int("backpressure", 0);
+  bmix = option_double("bmix", 0.0);
+  saturate = option_int("saturate", 0);
+  if (saturate) {
+    if (bmix > 0.0) {
+      printf("Saturation sends from A only, bmix must be 0\n");
+      exit(EXIT_FAILURE);
+    }
+    /* A is given a message whenever its window has room */
+    backpressure = 1;
+  }
+  if (file_enabled()) {
+    if (bmix > 0.0) {
+      printf("A file can only be sent from A to B, bmix must be 0\n");
+      exit(EXIT_FAILURE);
+    }
+    /* the file decides how many messages there are */
+    file_init(true, true);
+    nsimmax = file_chunks();
+  }
+  warmup = option_int("warmup", nsimmax / 10);
+  nflows = option_int("flows", 1);
+  if (nflows < 1)
+    nflows = 1;
+  nthreads = option_int("threads", 0);
+  if (nthreads < 0)
+    nthreads = 0;
+  if (nthreads > nflows)
+    nthreads = nflows;
+  /* a run whose event list keeps growing is stopped rather than left to
+     run out of memory.  A closed loop needs only a few events per flow,
+     an open one may queue many more. */
+  eventlimit = option_int("maxevents", saturate ? 1000 * nflows : nflows > 10000 ? 100 * nflows : 1000000);
+  /* the sequential engine can do as the parallel engine does, to check it */
+  flowstreams = nthreads > 0 || option_int("streams", 0);
+  if (nthreads > 0 && (option_string("record", "")[0] != '\0' || option_string("replay", "")[0] != '\0')) {
+    printf("The parallel engine can not record or replay\n");
+    exit(EXIT_FAILURE);
+  }
+  /* a snapshot does not hold the position in the log */
+  if ((option_string("record", "")[0] != '\0' || option_string("replay", "")[0] != '\0') &&
+      (option_string("restore", "")[0] != '\0' || option_string("branches", "")[0] != '\0')) {
+    printf("A run can not record or replay with restore or branches\n");
+    exit(EXIT_FAILURE);
+  }
+  if (option_string("eventlog", "")[0] != '\0') {
+    if (nthreads > 0 || option_string("restore", "")[0] != '\0' || option_string("branches", "")[0] != '\0') {
+      printf("The event log can only be written by the sequential engine, without restore or branches\n");
+      exit(EXIT_FAILURE);
+    }
+    evlog = fopen(option_string("eventlog", ""), "w");
+    if (evlog == NULL) {
+      perror(option_string("eventlog", ""));
+      exit(EXIT_FAILURE);
+    }
+  }
+  replay_init();
+  link_init();
+  topology_init();
+  loss_init(lossprob, corruptdirection);
+  delay_init();
+  stats_init();
+  traffic_init(nflows, lambda, bmix);
+  nheld = 0;
+  timers = calloc(2 * nflows, sizeof(struct event *));
+  blocked = calloc(2 * nflows, 1);
+  held = calloc(2 * nflows, 1);
+  flowstats = calloc(nflows, sizeof(struct flowstats));
+  streams = calloc(nflows + 1, sizeof(unsigned long));
+  if (timers == NULL || blocked == NULL || held == NULL || flowstats == NULL || streams == NULL) {
+    printf("memory allocation for flows failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (i=0; i<=nflows; i++)
+    streams[i] = seedstream(i);
+
+  time=0.0;                    /* initialize time to 0.0 */
+  for (i=0; i<nflows; i++) {
+    if (flowstreams)
+      rng = &streams[1 + i];
+    generate_next_arrival(i);  /* initialize event list */
+  }
+  rng = NULL;
+}
+
+/********************** Student-callable ROUTINES ***********************/
+
+/* called by students routine to cancel a previously-started timer */
+void stoptimer(int AorB)
+/* A or B is trying to stop timer */
+{
+  int entity = ENTITY(curflow, AorB);
+
+  if (TRACE>1)
+    printf("          STOP TIMER: stopping timer at %f\n",time);
+  /* each entity has at most one timer, so there is no need to search for it */
+  if (timers[entity] != NULL) {
+    STAT_INC(timer_stops);
+    if (evlog != NULL)
+      fprintf(evlog, "c %lu\n", timers[entity]->seq % SEQCLASS(1));
+    removeevent(timers[entity]);
+    free(timers[entity]);
+    timers[entity] = NULL;
+    return;
+  }
+  printf("Warning: unable to cancel your timer. It wasn't running.\n");
+}
+
+
+void starttimer(int AorB, double increment)
+/* A or B is trying to start timer */
+{
+
+  struct event *evptr;
+  int entity = ENTITY(curflow, AorB);
+
+  if (TRACE>1)
+    printf("          START TIMER: starting timer at %f\n",time);
+  /* be nice: check to see if timer is already started, if so, then  warn */
+  if (timers[entity] != NULL) {
+    printf("Warning: attempt to start a timer that is already started\n");
+    return;
+  }
+ 
+  /* create future event for when timer goes off */
+  evptr = malloc(sizeof(struct event));
+  if (evptr == 0) {
+    printf("memory allocation for event failed.");
+    exit(EXIT_FAILURE);
+  }
+  evptr->evtime =  time + increment;
+  evptr->evtype =  TIMER_INTERRUPT;
+   
+ 
+  evptr->eventity = entity;
+  timers[entity] = evptr;
+  insertevent(evptr);
+  STAT_INC(timer_starts);
+} 
+
+
+float get_sim_time(void)
+{
+  return time;
+}
+
+/* called by A or B when it can (0) or can not (1) accept more messages */
+void layer5_backpressure(int AorB, int on)
+{
+  int entity = ENTITY(curflow, AorB);
+
+  if (!backpressure || blocked[entity] == on)
+    return;
+  if (TRACE>1)
+    printf("          BACKPRESSURE: layer 5 at %s %s at %f\n", AorB == A ? "A" : "B",
+           on ? "blocked" : "resumed", time);
+  blocked[entity] = on;
+
+  /* release a held back arrival now */
+  if (!on && held[entity]) {
+    held[entity] = 0;
+    insertarrival(time, entity);
+  }
+}
+
+/************************** TOLAYER3 ***************/
+
+static void transmit(struct event *evptr);
+static void evpush(struct evarray *a, struct event *evptr);
+static void deliver(struct event *evptr);
+
+void tolayer3(int AorB, const struct pkt *packet)
+/* A or B is sending to network  */
+{
+  struct pkt *mypktptr;
+  struct event *evptr;
+
+  ntolayer3++;
+  flowstats[curflow].packets++;
+
+  /* make a copy of the packet student just gave me since he/she may decide */
+  /* to do something with the packet after we return back to him/her */ 
+  /* this is the only copy made on the way to the other side, and only the */
+  /* payload bytes in use are copied */
+  if (packet->length < 0 || packet->length > MAXPAYLOAD) {
+    printf("Warning: packet length %d is out of range, packet not sent\n", packet->length);
+    return;
+  }
+  mypktptr = allocpkt();
+  mypktptr->seqnum = packet->seqnum;
+  mypktptr->acknum = packet->acknum;
+  mypktptr->checksum = packet->checksum;
+  mypktptr->length = packet->length;
+  memcpy(mypktptr->payload, packet->payload, packet->length);
+
+  /* create future event for arrival of packet at the other side */
+  evptr = malloc(sizeof(struct event));
+  if (evptr == 0) {
+    printf("memory allocation for event failed.");
+    exit(EXIT_FAILURE);
+  }
+  evptr->evtype =  FROM_LAYER3;   /* packet will pop out from layer3 */
+  evptr->eventity = ENTITY(curflow, (AorB+1) % 2); /* event occurs at other entity */
+  evptr->pktptr = mypktptr;       /* save ptr to my copy of packet */
+  evptr->evtime = time;
+  evptr->hop = 1;
+
+  if (flowstreams) {
+    /* the parallel engine carries the packet through the network at the
+       end of the window, the sequential one once every event at this
+       time has been handled; the flow's packet count orders the packets
+       it sends at the same time */
+    evptr->evtype = TO_NETWORK;
+    evptr->seq = flowstats[curflow].packets;
+    evpush(nthreads > 0 ? &self->outbox : &sent, evptr);
+    return;
+  }
+  transmit(evptr);
+}
+
+/* free the event of a packet the network dropped */
+static void dropevent(struct event *evptr)
+{
+  freepkt(evptr->pktptr);
+  free(evptr);
+}
+
+/* put the arrival of a packet at a router or at the other side on the
+   event list, or in the parallel engine hand it to its flow's thread */
+static void schedule(struct event *evptr)
+{
+  if (nthreads > 0 && evptr->evtype == FROM_LAYER3)
+    deliver(evptr);
+  else
+    insertevent(evptr);
+}
+
+/* carry the packet of event evptr, sent at the current time, into the
+   channel: lose it, work out when it arrives and corrupt it */
+static void transmit(struct event *evptr)
+{
+  struct pkt *mypktptr = evptr->pktptr;
+  int AorB = 1 - SIDE(evptr->eventity);   /* the sender */
+  struct channelchoice c;         /* the random choices, replayed or drawn */
+  float lastime, x;
+  double arrival = 0.0;
+  int i, hops = 0;
+
+  replay_channel(curflow, AorB, &c);
+  STAT_INC(sent[AorB]);
+
+  /* simulate losses: */
+  if (c.lost < 0)
+    c.lost = loss_drop(AorB);
+  else
+    loss_count(AorB, c.lost);
+  if (c.lost) {
+    nlost++;
+    STAT_INC(lost[AorB]);
+    if (TRACE>0)    
+      printf("          TOLAYER3: packet being lost\n");
+    record_channel(curflow, AorB, &c);
+    dropevent(evptr);
+    return;
+  }  
+
+  /* send the packet over the first link of its path, which may drop it */
+  if (topology_enabled() &&
+      (hops = topology_forward(curflow, AorB, 0, time, PKTHEADER + mypktptr->length, &arrival)) < 0) {
+    STAT_INC(dropped[AorB]);
+    record_channel(curflow, AorB, &c);
+    dropevent(evptr);
+    return;
+  }
+
+  /* queue the packet at the bottleneck link, which may drop it */
+  if (!topology_enabled() && link_enabled() && !link_send(AorB, time, PKTHEADER + mypktptr->length, &arrival)) {
+    STAT_INC(dropped[AorB]);
+    record_channel(curflow, AorB, &c);
+    dropevent(evptr);
+    return;
+  }
+
+  if (TRACE>2)  {
+    printf("          TOLAYER3: seq: %d, ack %d, check: %d ", mypktptr->seqnum,
+           mypktptr->acknum,  mypktptr->checksum);
+    for (i=0; i<MSGSIZE && i<mypktptr->length; i++)
+      printf("%c",mypktptr->payload[i]);
+    if (mypktptr->length > MSGSIZE)
+      printf("... (%d bytes)", mypktptr->length);
+    printf("\n");
+  }
+
+  evptr->evtype =  FROM_LAYER3;   /* packet will pop out from layer3 */
+  /* finally, compute the arrival time of packet at the other end.
+     medium can not reorder, so make sure packet arrives between 1 and 10
+     time units (or the chosen delay) after the latest arrival time of
+     packets currently in the medium on their way to the destination.
+     All flows share the medium, so this is the latest arrival at any
+     entity on the destination's side, which is tracked rather than
+     searched for.  In reorder mode the delay counts from now instead.
+     The bottleneck link has already worked out when the packet arrives,
+     and in a topology the first link when it reaches the next node */
+  if (topology_enabled()) {
+    evptr->evtime = arrival;
+    if (hops > 0)
+      evptr->evtype = FROM_ROUTER;
+  }
+  else if (link_enabled())
+    evptr->evtime = arrival;
+  else {
+    lastime = time;
+    if (!delay_reorder() && lastarrival[(AorB+1) % 2] > lastime)
+      lastime = lastarrival[(AorB+1) % 2];
+    if (c.delay < 0.0)
+      c.delay = delay_sample();
+    evptr->evtime =  lastime + c.delay;
+  }
+  /* a topology keeps each path in order, one link at a time */
+  if (!topology_enabled()) {
+    if (evptr->evtime < lastarrival[(AorB+1) % 2])
+      nreordered++;
+    else
+      lastarrival[(AorB+1) % 2] = evptr->evtime;
+  }
+ 
+
+
+  /* simulate corruption: */
+  if (c.corrupt < 0.0)
+    c.corrupt = jimsrand();
+  if ((c.corrupt < corruptprob)  && (!(AorB == B && corruptdirection == A) && !(AorB == A && corruptdirection == B))) {
+    ncorrupt++;
+    STAT_INC(corrupt[AorB]);
+    if (c.kind < 0.0)
+      c.kind = jimsrand();
+    if ( (x = c.kind) < .75 && mypktptr->length > 0)
+      mypktptr->payload[0]='Z';   /* corrupt payload */
+    else if (x < .875)            /* (or the header if there is no payload) */
+      mypktptr->seqnum = 999999;
+    else
+      mypktptr->acknum = 999999;
+    if (TRACE>0)    
+      printf("          TOLAYER3: packet being corrupted\n");
+  }  
+
+  record_channel(curflow, AorB, &c);
+
+  if (TRACE>2)  
+    printf("          TOLAYER3: scheduling arrival on other side\n");
+  schedule(evptr);
+} 
+
+/* the messages flow must deliver before its steady state starts */
+static int warmupshare(int flow)
+{
+  return warmup / nflows + (flow < warmup % nflows);
+}
+
+void tolayer5(int AorB, const char datasent[MSGSIZE])
+{
+  int i;  
+  if (TRACE>2) {
+    printf("          TOLAYER5: data received by application at ");
+    if (AorB == A) 
+      printf("A: ");
+    else
+      printf("B: ");
+    for (i=0; i<20; i++)  
+      printf("%c",datasent[i]);
+    printf("\n");
+  }
+  messages_delivered++;
+  flowstats[curflow].delivered++;
+  if (saturate) {
+    if (flowstats[curflow].delivered == warmupshare(curflow))
+      flowstats[curflow].warmed = time;
+    flowstats[curflow].lastdelivery = time;
+  }
+  if (AorB == B && file_enabled())
+    file_deliver(datasent);
+}
+
+int flow_count(void)
+{
+  return nflows;
+}
+
+int current_flow(void)
+{
+  return curflow;
+}
+
+/* print per-flow goodput and Jain's fairness index over the flows */
+static void flowreport(void)
+{
+  double x, sum = 0.0, sumsq = 0.0, lo = 0.0, hi = 0.0;
+  int i;
+
+  for (i=0; i<nflows; i++) {
+    /* goodput in bytes per time unit */
+    x = time > 0.0 ? (double)flowstats[i].delivered * MSGSIZE / time : 0.0;
+    if (i == 0 || x < lo)
+      lo = x;
+    if (i == 0 || x > hi)
+      hi = x;
+    sum += x;
+    sumsq += x * x;
+    if (option_int("flowstats", 0))
+      printf("flow %d: messages generated %d, delivered %d, packets sent %d, goodput %f \n",
+             i, flowstats[i].generated, flowstats[i].delivered, flowstats[i].packets, x);
+  }
+  printf("number of flows:  %d \n", nflows);
+  printf("per-flow goodput (bytes per time unit):  min %f, mean %f, max %f \n", lo, sum / nflows, hi);
+  printf("Jain's fairness index:  %f \n", sumsq > 0.0 ? sum * sum / (nflows * sumsq) : 1.0);
+}
+
+/* print the goodput of the saturated flows after the warm-up, the sum
+   over the flows of the messages each delivered after its share of the
+   warm-up divided by the time it took */
+static void saturationreport(void)
+{
+  double rate = 0.0;
+  int i, w, steady = 0;
+
+  /* a collapsed run has no steady state */
+  for (i=0; i<nflows && !collapsed; i++) {
+    w = warmupshare(i);
+    if (flowstats[i].delivered > w && flowstats[i].lastdelivery > flowstats[i].warmed) {
+      rate += (flowstats[i].delivered - w) / (flowstats[i].lastdelivery - flowstats[i].warmed);
+      steady++;
+    }
+  }
+  printf("saturation: warm-up of %d messages, flows that reached steady state:  %d \n", warmup, steady);
+  printf("steady-state goodput (messages per time unit):  %f \n", rate);
+  printf("steady-state goodput (bytes per time unit):  %f \n", rate * MSGSIZE);
+}
+
+/* is the run to stop because its event lists hold more than eventlimit
+   events?  Only congestion collapse makes them grow without end. */
+static bool overgrown(int events)
+{
+  if (eventlimit <= 0 || events <= eventlimit)
+    return false;
+  fprintf(results_replace_summary() ? stderr : stdout,
+          "Simulation stopped at time %f: more than %d events, congestion collapse\n", time, eventlimit);
+  collapsed = true;
+  return true;
+}
+
+/* may layer 5 give the current flow another message? */
+static bool moremessages(void)
+{
+  if (!flowstreams)
+    return nsim < nsimmax;
+  /* the parallel engine gives each flow a fixed share of the messages, so
+     that no flow's share depends on how far the others have got */
+  return flowstats[curflow].generated < nsimmax / nflows + (curflow < nsimmax % nflows);
+}
+
+/* a packet has reached a router, send it on over the next link */
+static void forward(struct event *eventptr)
+{
+  double arrival;
+  int hops;
+
+  hops = topology_forward(curflow, 1 - SIDE(eventptr->eventity), eventptr->hop, time,
+                          PKTHEADER + eventptr->pktptr->length, &arrival);
+  if (hops < 0) {
+    STAT_INC(dropped[1 - SIDE(eventptr->eventity)]);
+    dropevent(eventptr);
+    return;
+  }
+  eventptr->evtime = arrival;
+  eventptr->evtype = hops > 0 ? FROM_ROUTER : FROM_LAYER3;
+  eventptr->hop++;
+  schedule(eventptr);
+}
+
+/* simulate one event, then free it unless it has been scheduled again */
+static void dispatch(struct event *eventptr)
+{
+  struct msg  msg2give;
+  int i,j,resent;
+
+  if (TRACE>=2) {
+    printf("\nEVENT time: %f,",eventptr->evtime);
+    printf("  type: %d",eventptr->evtype);
+    if (eventptr->evtype==0)
+      printf(", timerinterrupt  ");
+    else if (eventptr->evtype==1)
+      printf(", fromlayer5 ");
+    else if (eventptr->evtype==FROM_ROUTER)
+      printf(", fromrouter ");
+    else
+      printf(", fromlayer3 ");
+    printf(" entity: %d\n",eventptr->eventity);
+  }
+  time = eventptr->evtime;        /* update time to next event time */
+  curflow = FLOW(eventptr->eventity);
+  if (flowstreams)
+    rng = &streams[1 + curflow];
+  if (eventptr->evtype == FROM_LAYER5 ) {
+    if (moremessages() && blocked[eventptr->eventity]) {
+      /* hold the arrival until the sender asks for more messages */
+      if (TRACE > 2)
+        printf("          FROM_LAYER5: sender is blocked, holding message\n");
+      held[eventptr->eventity] = 1;
+      nheld++;
+    }
+    else if (moremessages()) {
+      generate_next_arrival(curflow);   /* set up future arrival */
+      /* fill in msg to give with string of same letter */    
+      j = (flowstreams ? flowstats[curflow].generated : nsim) % 26; 
+      for (i=0; i<20; i++)  
+        msg2give.data[i] = 97 + j;
+      if (file_enabled())
+        file_message(flowstreams ? flowstats[curflow].generated * nflows + curflow : nsim, &msg2give);
+      if (TRACE>2) {
+        printf("          MAINLOOP: data given to student: ");
+        for (i=0; i<20; i++) 
+          printf("%c", msg2give.data[i]);
+        printf("\n");
+      }
+      nsim++;
+      flowstats[curflow].generated++;
+      if (SIDE(eventptr->eventity) == A) 
+        A_output(&msg2give);  
+      else
+        B_output(&msg2give);  
+    }
+    else if (TRACE > 2)
+        printf("          FROM_LAYER5: no more messages to send: \n");
+  }
+  else if (eventptr->evtype ==  FROM_LAYER3) {
+	    if (SIDE(eventptr->eventity) ==A)      /* deliver packet by calling */
+      A_input(eventptr->pktptr);     /* appropriate entity */
+    else
+      B_input(eventptr->pktptr);
+	    freepkt(eventptr->pktptr);       /* recycle the packet buffer */
+  }
+  else if (eventptr->evtype == FROM_ROUTER) {
+    if (flowstreams)
+      rng = &streams[0];          /* routers draw from the network's stream */
+    forward(eventptr);
+    return;
+  }
+  else if (eventptr->evtype ==  TIMER_INTERRUPT) {
+    timers[eventptr->eventity] = NULL;
+    STAT_INC(timeouts);
+    resent = packets_resent;
+    if (SIDE(eventptr->eventity) == A) 
+      A_timerinterrupt();
+    else
+      B_timerinterrupt();
+    /* the first packet resent is the one that timed out, GBN resends the
+       rest of its window with it */
+    resent = packets_resent - resent;
+    STAT_ADD(resent_timeout, resent > 0);
+    STAT_ADD(resent_goback, resent > 1 ? resent - 1 : 0);
+  }
+  else  {
+    printf("INTERNAL PANIC: unknown event type \n");
+  }
+  free(eventptr);
+}
+
+/* count and, with tsc=1, time the handling of an event */
+static void handle(struct event *eventptr)
+{
+#ifdef NOSTATS
+  dispatch(eventptr);
+#else
+  int type = eventptr->evtype;
+  unsigned long began;
+
+  STAT_INC(events[type]);
+  STAT_ADD(depthsum, nevents);
+  STAT_MAX(depthmax, nevents);
+  if (!stats_timing) {
+    dispatch(eventptr);
+    return;
+  }
+  began = stats_clock();
+  dispatch(eventptr);
+  STAT_ADD(ticks[type], stats_clock() - began);
+#endif
+}
+
+/********************* PARALLEL ENGINE **************/
+/*  The flows are spread over worker threads, each   */
+/*  with an event list of its own, and the network   */
+/*  they share is simulated by the main thread.      */
+/*  Time advances in windows no longer than the      */
+/*  least delay through the network, so a packet     */
+/*  sent in a window arrives after it: the threads   */
+/*  run a window independently, then the main thread */
+/*  carries the packets sent in it through the       */
+/*  network in time order and hands their arrivals   */
+/*  to the threads.  Every flow and the network draw */
+/*  from random number streams of their own, so the  */
+/*  results are the same for any number of threads.  */
+/*****************************************************/
+
+static float windowend;            /* the window holds the events before this time */
+static bool finished;              /* there are no events left */
+
+static void evpush(struct evarray *a, struct event *evptr)
+{
+  if (a->n == a->max) {
+    a->max = a->max ? 2 * a->max : 64;
+    a->ev = realloc(a->ev, a->max * sizeof(struct event *));
+    if (a->ev == NULL) {
+      printf("memory allocation for event list failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  a->ev[a->n++] = evptr;
+}
+
+/* hand the arrival of a packet at A or B to the flow's thread */
+static void deliver(struct event *evptr)
+{
+  /* a packet sent in the window arrives after it, unless rounding the
+     arrival time to a float has moved it back */
+  if (evptr->evtime < windowend)
+    evptr->evtime = windowend;
+  evpush(&workers[FLOW(evptr->eventity) % nthreads].inbox, evptr);
+}
+
+static void savecounters(struct counters *c)
+{
+  c->window_full = window_full;
+  c->total_ACKs_received = total_ACKs_received;
+  c->packets_resent = packets_resent;
+  c->new_ACKs = new_ACKs;
+  c->packets_received = packets_received;
+  c->acks_sent = acks_sent;
+  c->acks_piggybacked = acks_piggybacked;
+  c->packets_buffered = packets_buffered;
+  c->messages_queued = messages_queued;
+  c->sendqueue_maxdepth = sendqueue_maxdepth;
+  c->sendqueue_delay = sendqueue_delay;
+  c->messages_delivered = messages_delivered;
+  c->nsim = nsim;
+  c->ntolayer3 = ntolayer3;
+  c->nheld = nheld;
+}
+
+static void addcounters(const struct counters *c)
+{
+  window_full += c->window_full;
+  total_ACKs_received += c->total_ACKs_received;
+  packets_resent += c->packets_resent;
+  new_ACKs += c->new_ACKs;
+  packets_received += c->packets_received;
+  acks_sent += c->acks_sent;
+  acks_piggybacked += c->acks_piggybacked;
+  packets_buffered += c->packets_buffered;
+  messages_queued += c->messages_queued;
+  if (c->sendqueue_maxdepth > sendqueue_maxdepth)
+    sendqueue_maxdepth = c->sendqueue_maxdepth;
+  sendqueue_delay += c->sendqueue_delay;
+  messages_delivered += c->messages_delivered;
+  nsim += c->nsim;
+  ntolayer3 += c->ntolayer3;
+  nheld += c->nheld;
+}
+
+static void *worker(void *arg)
+{
+  int i;
+
+  self = arg;
+  while (1) {
+    threads_barrier();                  /* the main thread has set the window */
+    if (finished)
+      break;
+    for (i = 0; i < self->inbox.n; i++)
+      insertevent(self->inbox.ev[i]);
+    self->inbox.n = 0;
+    while (nevents > 0 && evheap[0]->evtime < windowend)
+      handle(nextevent());
+    self->next = nevents > 0 ? evheap[0]->evtime : -1.0;
+    self->nevents = nevents;
+    threads_barrier();                  /* the window is done */
+  }
+  self->last = time;
+  savecounters(&self->counters);
+  stats_save(&workerstats[self - workers]);
+  return NULL;
+}
+
+/* the order packets sent at the same time go into the network: by flow,
+   then in the order the flow sent them */
+static int sendorder(const void *a, const void *b)
+{
+  const struct event *p = *(struct event * const *)a;
+  const struct event *q = *(struct event * const *)b;
+
+  if (p->evtime != q->evtime)
+    return p->evtime < q->evtime ? -1 : 1;
+  if (FLOW(p->eventity) != FLOW(q->eventity))
+    return FLOW(p->eventity) < FLOW(q->eventity) ? -1 : 1;
+  return p->seq < q->seq ? -1 : p->seq > q->seq;
+}
+
+/* with streams the sequential engine carries the packets sent at the
+   current time into the network as the parallel engine does: in flow
+   order, ahead of the packets waiting at routers, with the network's
+   random number stream */
+static void sendall(void)
+{
+  int i;
+
+  qsort(sent.ev, sent.n, sizeof(struct event *), sendorder);
+  rng = &streams[0];
+  for (i = 0; i < sent.n; i++) {
+    curflow = FLOW(sent.ev[i]->eventity);
+    transmit(sent.ev[i]);
+  }
+  sent.n = 0;
+}
+
+/* carry the packets sent in the window through the network, on the main
+   thread's event list, which holds the packets waiting at routers */
+static void network(void)
+{
+  struct event *evptr;
+  int i, j;
+
+  for (i = 0; i < nthreads; i++) {
+    for (j = 0; j < workers[i].outbox.n; j++)
+      evpush(&sent, workers[i].outbox.ev[j]);
+    workers[i].outbox.n = 0;
+  }
+  qsort(sent.ev, sent.n, sizeof(struct event *), sendorder);
+  /* events at the same time come out of the event list newest first */
+  for (i = sent.n - 1; i >= 0; i--)
+    insertevent(sent.ev[i]);
+  sent.n = 0;
+
+  while (nevents > 0 && evheap[0]->evtime < windowend) {
+    evptr = nextevent();
+    time = evptr->evtime;
+    curflow = FLOW(evptr->eventity);
+    if (evptr->evtype == TO_NETWORK)
+      transmit(evptr);
+    else
+      forward(evptr);
+  }
+}
+
+/* the time of the next event anywhere, or -1 if there is none */
+static float earliest(void)
+{
+  float next = nevents > 0 ? evheap[0]->evtime : -1.0;
+  int i, j;
+
+  for (i = 0; i < nthreads; i++) {
+    if (workers[i].next >= 0.0 && (next < 0.0 || workers[i].next < next))
+      next = workers[i].next;
+    for (j = 0; j < workers[i].inbox.n; j++)
+      if (next < 0.0 || workers[i].inbox.ev[j]->evtime < next)
+        next = workers[i].inbox.ev[j]->evtime;
+  }
+  return next;
+}
+
+/* the events on every list, and the arrivals waiting to go on one */
+static int allevents(void)
+{
+  int i, n = nevents;
+
+  for (i = 0; i < nthreads; i++)
+    n += workers[i].nevents + workers[i].inbox.n;
+  return n;
+}
+
+static void parallel(void)
+{
+  struct event *evptr;
+  double lookahead;
+  float start;
+  int i;
+
+  /* the least time a packet takes to cross the network */
+  if (topology_enabled())
+    lookahead = topology_lookahead();
+  else if (link_enabled())
+    lookahead = link_lookahead();
+  else
+    lookahead = delay_lookahead();
+  if (lookahead <= 0.0) {
+    printf("The parallel engine needs the network's least delay to be above 0, not %f\n", lookahead);
+    exit(EXIT_FAILURE);
+  }
+
+  workers = calloc(nthreads, sizeof(struct worker));
+  if (workers == NULL) {
+    printf("memory allocation for threads failed.");
+    exit(EXIT_FAILURE);
+  }
+  workerstats = stats_alloc(nthreads);
+  /* the flows' first events go to their threads */
+  while ((evptr = nextevent()) != NULL)
+    evpush(&workers[FLOW(evptr->eventity) % nthreads].inbox, evptr);
+  for (i = 0; i < nthreads; i++)
+    workers[i].next = -1.0;
+  threads_start(nthreads, worker, workers, sizeof(struct worker));
+
+  rng = &streams[0];
+  while ((start = earliest()) >= 0.0 && !overgrown(allevents())) {
+    windowend = start + lookahead;
+    if (windowend <= start) {
+      printf("The parallel engine can not advance time beyond %f\n", start);
+      exit(EXIT_FAILURE);
+    }
+    if (realtime_enabled())
+      realtime_wait(start);             /* the window starts on time */
+    threads_barrier();                  /* run the window */
+    threads_barrier();                  /* wait for every thread to finish it */
+    network();
+  }
+  finished = true;
+  threads_barrier();
+  threads_join();
+
+  for (i = 0; i < nthreads; i++) {
+    addcounters(&workers[i].counters);
+    stats_merge(&workerstats[i]);
+    if (workers[i].last > time)
+      time = workers[i].last;
+  }
+}
+
+/********************* CHECKPOINTS ******************/
+/*  At the time given by the checkpoint option the   */
+/*  sequential engine takes a snapshot of the whole  */
+/*  simulation, see checkpoint.h.  It is written to  */
+/*  the file given by the save option, and with the  */
+/*  branches option the simulation forks into one    */
+/*  process per branch, each going on with its own   */
+/*  loss and corruption probabilities.               */
+/*****************************************************/
+
+#define SNAPSHOT_MAGIC "emulator snapshot 1"
+
+static pid_t *branchpids;         /* the processes running the branches */
+static int nbranches;
+
+static void savestate(FILE *fp)
+{
+  struct counters c;
+  struct event *p;
+  int i, istimer;
+
+  checkpoint_write(fp, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+  checkpoint_write(fp, &nflows, sizeof(int));
+  checkpoint_write(fp, &time, sizeof(float));
+  checkpoint_write(fp, &ndraws, sizeof(unsigned long));
+  savecounters(&c);
+  checkpoint_write(fp, &c, sizeof(struct counters));
+  checkpoint_write(fp, &nlost, sizeof(int));
+  checkpoint_write(fp, &ncorrupt, sizeof(int));
+  checkpoint_write(fp, &nreordered, sizeof(int));
+  checkpoint_write(fp, lastarrival, sizeof(lastarrival));
+  checkpoint_write(fp, flowstats, nflows * sizeof(struct flowstats));
+  checkpoint_write(fp, blocked, 2 * nflows);
+  checkpoint_write(fp, held, 2 * nflows);
+
+  /* the event list in heap order, with the packets in flight */
+  checkpoint_write(fp, &evseq, sizeof(unsigned long));
+  checkpoint_write(fp, &nevents, sizeof(int));
+  for (i = 0; i < nevents; i++) {
+    p = evheap[i];
+    istimer = timers[p->eventity] == p;
+    checkpoint_write(fp, p, sizeof(struct event));
+    checkpoint_write(fp, &istimer, sizeof(int));
+    if (p->evtype == FROM_LAYER3 || p->evtype == FROM_ROUTER)
+      checkpoint_write(fp, p->pktptr, PKTHEADER + p->pktptr->length);
+  }
+
+  protocol_save_state(fp);
+  link_save_state(fp);
+  loss_save_state(fp);
+  traffic_save_state(fp);
+  stats_save_state(fp);
+  if (topology_enabled())
+    topology_save_state(fp);
+}
+
+static void restorestate(FILE *fp)
+{
+  char magic[sizeof(SNAPSHOT_MAGIC)];
+  struct counters c;
+  struct event *p;
+  unsigned long draws, seq;
+  int i, n, istimer;
+
+  checkpoint_read(fp, magic, sizeof(magic));
+  if (memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0)
+    checkpoint_mismatch("it is not a snapshot");
+  checkpoint_read(fp, &n, sizeof(int));
+  if (n != nflows)
+    checkpoint_mismatch("the flows option differs");
+  checkpoint_read(fp, &time, sizeof(float));
+
+  /* rand() has no state to restore, so it is run up to the same position */
+  checkpoint_read(fp, &draws, sizeof(unsigned long));
+  srand(seed);
+  for (ndraws = 0; ndraws < draws; ndraws++)
+    rand();
+
+  checkpoint_read(fp, &c, sizeof(struct counters));
+  addcounters(&c);
+  checkpoint_read(fp, &nlost, sizeof(int));
+  checkpoint_read(fp, &ncorrupt, sizeof(int));
+  checkpoint_read(fp, &nreordered, sizeof(int));
+  checkpoint_read(fp, lastarrival, sizeof(lastarrival));
+  checkpoint_read(fp, flowstats, nflows * sizeof(struct flowstats));
+  checkpoint_read(fp, blocked, 2 * nflows);
+  checkpoint_read(fp, held, 2 * nflows);
+
+  /* the snapshot's events replace the first arrivals init() scheduled.
+     They are put back in the same heap order with the same sequence
+     numbers, so ties come out as they would have. */
+  while ((p = nextevent()) != NULL)
+    free(p);
+  for (i = 0; i < 2 * nflows; i++)
+    timers[i] = NULL;
+  checkpoint_read(fp, &seq, sizeof(unsigned long));
+  checkpoint_read(fp, &n, sizeof(int));
+  for (i = 0; i < n; i++) {
+    p = malloc(sizeof(struct event));
+    if (p == 0) {
+      printf("memory allocation for event failed.");
+      exit(EXIT_FAILURE);
+    }
+    checkpoint_read(fp, p, sizeof(struct event));
+    checkpoint_read(fp, &istimer, sizeof(int));
+    if (p->eventity < 0 || p->eventity >= 2 * nflows)
+      checkpoint_mismatch("an event is for an entity that does not exist");
+    p->pktptr = NULL;
+    if (p->evtype == FROM_LAYER3 || p->evtype == FROM_ROUTER) {
+      p->pktptr = allocpkt();
+      checkpoint_read(fp, p->pktptr, PKTHEADER);
+      if (p->pktptr->length < 0 || p->pktptr->length > MAXPAYLOAD)
+        checkpoint_mismatch("a packet is too long");
+      checkpoint_read(fp, p->pktptr->payload, p->pktptr->length);
+    }
+    if (istimer)
+      timers[p->eventity] = p;
+    evgrow();
+    evplace(p, nevents++);
+  }
+  evseq = seq;
+
+  protocol_restore_state(fp);
+  link_restore_state(fp);
+  loss_restore_state(fp);
+  traffic_restore_state(fp);
+  stats_restore_state(fp);
+  if (topology_enabled())
+    topology_restore_state(fp);
+}
+
+/* fork a process for each branch of the branches option, a comma
+   separated list of loss:corruption probabilities.  Each branch writes
+   its output to branchN.txt, N counting from 0, while this process goes
+   on with the probabilities read from standard input. */
+static void forkbranches(const char *spec)
+{
+  char name[32];
+  double loss, corrupt;
+  pid_t pid;
+
+  fflush(stdout);      /* or the branches would print it again */
+  while (*spec != '\0') {
+    if (sscanf(spec, "%lf:%lf", &loss, &corrupt) != 2) {
+      printf("Warning: can not read branch %s, branches must be loss:corruption pairs\n", spec);
+      return;
+    }
+    branchpids = realloc(branchpids, (nbranches + 1) * sizeof(pid_t));
+    if (branchpids == NULL) {
+      printf("memory allocation for branches failed.");
+      exit(EXIT_FAILURE);
+    }
+    pid = fork();
+    if (pid < 0) {
+      printf("can not fork branch %d\n", nbranches);
+      exit(EXIT_FAILURE);
+    }
+    if (pid == 0) {
+      sprintf(name, "branch%d.txt", nbranches);
+      if (freopen(name, "w", stdout) == NULL)
+        exit(EXIT_FAILURE);
+      nbranches = 0;
+      lossprob = loss;
+      corruptprob = corrupt;
+      loss_setprob(lossprob);
+      printf("branch from time %f with packet loss probability %f, corruption probability %f\n",
+             time, lossprob, corruptprob);
+      return;
+    }
+    branchpids[nbranches++] = pid;
+    spec = strchr(spec, ',') ? strchr(spec, ',') + 1 : "";
+  }
+}
+
+/* take the snapshot of the current state */
+static void checkpoint(void)
+{
+  const char *path = option_string("save", "");
+  const char *branches = option_string("branches", "");
+  FILE *fp;
+
+  if (path[0] == '\0' && branches[0] == '\0')
+    path = "snapshot.bin";
+  if (path[0] != '\0') {
+    fp = fopen(path, "wb");
+    if (fp == NULL) {
+      printf("can not write snapshot %s\n", path);
+      exit(EXIT_FAILURE);
+    }
+    savestate(fp);
+    fclose(fp);
+    if (TRACE>0)
+      printf("          CHECKPOINT: snapshot of time %f saved to %s\n", time, path);
+  }
+  if (branches[0] != '\0')
+    forkbranches(branches);
+}
+
+/* start from the snapshot in the file given by the restore option */
+static void restore(const char *path)
+{
+  FILE *fp = fopen(path, "rb");
+
+  if (fp == NULL) {
+    printf("can not read snapshot %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  restorestate(fp);
+  fclose(fp);
+  if (TRACE>0)
+    printf("          CHECKPOINT: restored snapshot of time %f from %s\n", time, path);
+}
+
+/* print the results of the run in words */
+static void summary(void)
+{
+  printf(" Simulator terminated at time %f\n after attempting to send %d msgs from layer5\n",time,nsim);
+  printf("number of messages dropped due to full window:  %d \n", window_full);
+  printf("number of valid (not corrupt or duplicate) acknowledgements received at A:  %d \n", new_ACKs);
+  printf("(note: a single acknowledgement may have acknowledged more than one packet - if cumulative acknowledgements are used)\n");
+  printf("number of packet resends by A:  %d \n", packets_resent);
+  printf("number of correct packets received at B:  %d \n", packets_received);
+  printf("number of messages delivered to application:  %d \n", messages_delivered);
+  if (messages_queued > 0 || nheld > 0) {
+    printf("number of messages queued due to full window:  %d \n", messages_queued);
+    printf("maximum send queue depth:  %d \n", sendqueue_maxdepth);
+    printf("average queueing delay:  %f \n", messages_queued > 0 ? sendqueue_delay / messages_queued : 0.0);
+    printf("number of arrivals held back by backpressure:  %d \n", nheld);
+  }
+  if (nflows > 1)
+    flowreport();
+  if (saturate)
+    saturationreport();
+  link_report(time);
+  topology_report(time);
+  if (delay_reorder()) {
+    printf("number of packets reordered by the channel:  %d \n", nreordered);
+    printf("number of packets buffered out of order by the receiver:  %d \n", packets_buffered);
+  }
+  loss_report();
+  replay_report();
+  traffic_report();
+  stats_report();
+  realtime_report();
+  if (file_enabled())
+    file_report(0.0, time);
+  if (bmix > 0.0) {
+    printf("number of ACKs sent on their own:  %d \n", acks_sent);
+    printf("number of ACKs piggybacked on data:  %d \n", acks_piggybacked);
+    printf("packets sent per message delivered:  %f \n",
+           messages_delivered > 0 ? (double)ntolayer3 / messages_delivered : 0.0);
+  }
+}
+
+/* write the configuration and every counter as a record for scripts */
+static void results(void)
+{
+  const char *opt;
+  char given[512];
+  size_t len = 0;
+  int i;
+
+  given[0] = '\0';
+  for (i = 0; (opt = option_given(i)) != NULL; i++)
+    if (len + strlen(opt) + 2 < sizeof(given)) {
+      sprintf(given + len, "%s%s", len > 0 ? " " : "", opt);
+      len = strlen(given);
+    }
+  results_string("options", given);
+  results_int("messages", nsimmax);
+  results_double("lossprob", lossprob);
+  results_double("corruptprob", corruptprob);
+  results_int("corruptdirection", corruptdirection);
+  results_double("lambda", lambda);
+  results_int("trace", TRACE);
+  results_int("seed", seed);
+  results_int("flows", nflows);
+  results_int("threads", nthreads);
+  results_double("time", time);
+  results_int("nsim", nsim);
+  results_int("collapsed", collapsed);
+  results_int("window_full", window_full);
+  results_int("new_ACKs", new_ACKs);
+  results_int("total_ACKs_received", total_ACKs_received);
+  results_int("packets_resent", packets_resent);
+  results_int("packets_received", packets_received);
+  results_int("messages_delivered", messages_delivered);
+  results_int("messages_queued", messages_queued);
+  results_int("sendqueue_maxdepth", sendqueue_maxdepth);
+  results_double("sendqueue_delay", messages_queued > 0 ? sendqueue_delay / messages_queued : 0.0);
+  results_int("nheld", nheld);
+  results_int("ntolayer3", ntolayer3);
+  results_int("nlost", nlost);
+  results_int("ncorrupt", ncorrupt);
+  results_int("nreordered", nreordered);
+  results_int("packets_buffered", packets_buffered);
+  results_int("acks_sent", acks_sent);
+  results_int("acks_piggybacked", acks_piggybacked);
+  results_double("goodput", time > 0.0 ? (double)messages_delivered * MSGSIZE / time : 0.0);
+  stats_results();
+  results_emit();
+}
+
+/* print the summary on standard error when the results record takes
+   standard output.  The reports print to standard output, so that is
+   pointed at standard error while they run. */
+static void summaryonstderr(void)
+{
+  int out;
+
+  fflush(stdout);
+  out = dup(STDOUT_FILENO);
+  if (out < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+    perror("summary");
+    exit(EXIT_FAILURE);
+  }
+  summary();
+  fflush(stdout);
+  dup2(out, STDOUT_FILENO);
+  close(out);
+}
+
+int main(int argc, char *argv[])
+{
+  double checkpointtime;
+  int i;
+  
+  options_init(argc, argv);
+  results_init();
+  init();
+  for (curflow=0; curflow<nflows; curflow++) {
+    A_init();
+    B_init();
+  }
+  checkpointtime = option_double("checkpoint", -1.0);
+  if (flowstreams && (checkpointtime >= 0.0 || option_string("restore", "")[0] != '\0')) {
+    printf("The parallel engine and streams=1 can not take or restore snapshots\n");
+    exit(EXIT_FAILURE);
+  }
+  if (option_string("restore", "")[0] != '\0')
+    restore(option_string("restore", ""));
+  realtime_init(time);
+   
+  if (nthreads > 0)
+    parallel();
+  else
+    while (nevents > 0 && !overgrown(nevents)) {
+      if (checkpointtime >= 0.0 && evheap[0]->evtime > checkpointtime) {
+        checkpoint();
+        checkpointtime = -1.0;
+      }
+      if (realtime_enabled())
+        realtime_wait(evheap[0]->evtime);
+      handle(nextevent());      /* simulate the next event */
+      if (sent.n > 0 && (nevents == 0 || evheap[0]->evtime > time || evheap[0]->evtype == FROM_ROUTER))
+        sendall();
+    }
+  if (checkpointtime >= 0.0)
+    fprintf(results_replace_summary() ? stderr : stdout,
+            "Warning: the simulation ended before the checkpoint, no snapshot taken\n");
+
+  if (evlog != NULL)
+    fclose(evlog);
+  if (!results_replace_summary())
+    summary();
+  else
+    summaryonstderr();
+  if (results_enabled())
+    results();
+
+  /* wait for the branches to finish */
+  fflush(stdout);
+  for (i = 0; i < nbranches; i++)
+    waitpid(branchpids[i], NULL, 0);
+  return EXIT_SUCCESS;
 }
\ No newline at end of file
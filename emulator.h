@@ -1,40 +1,78 @@
-extern int TRACE;
-
-/* statistics updated by GBN */
-extern int total_ACKs_received;
-extern int packets_resent;       /* count of the number of packets resent  */
-extern int new_ACKs;      /* count of the number of acks correctly received */
-extern int packets_received;  /* count of the packets received by receiver */
-extern int window_full; /* count of the number of messages dropped due to full window */
-
-#define   A    0
-#define   B    1
-
-/* a "msg" is the data unit passed from layer 5 (teachers code) to layer  */
-/* 4 (students' code).  It contains the data (characters) to be delivered */
-/* to layer 5 via the students transport level protocol entities.         */
-struct msg {
-  char data[20];
-};
-
-/* a packet is the data unit passed from layer 4 (students code) to layer */
-/* 3 (teachers code).  Note the pre-defined packet structure, which all   */
-/* students must follow. */
-struct pkt {
-  int seqnum;
-  int acknum;
-  int checksum;
-  char payload[20];
-};
-
-/* send to A or B (int), packet to send */
-extern void tolayer3(int, struct pkt);  
-
-/* deliver to A or B (int), data to deliver */
-extern void tolayer5(int, char[20]); 
-
-/* start timer at A or B (int), increment */
-extern void starttimer(int, double);       
-
-/* stop timer at A or B (int) */
-extern void stoptimer(int);               
+extern int TRACE;
+
+/* the parallel engine (the threads option) runs groups of flows on
+   threads of their own, each keeping its own statistics, which are added
+   up when the simulation ends */
+#define THREADLOCAL __thread
+
+/* statistics updated by GBN */
+extern THREADLOCAL int total_ACKs_received;
+extern THREADLOCAL int packets_resent;       /* count of the number of packets resent  */
+extern THREADLOCAL int new_ACKs;      /* count of the number of acks correctly received */
+extern THREADLOCAL int packets_received;  /* count of the packets received by receiver */
+extern THREADLOCAL int window_full; /* count of the number of messages dropped due to full window */
+extern THREADLOCAL int acks_sent;        /* count of the ACKs sent in packets of their own */
+extern THREADLOCAL int acks_piggybacked; /* count of the ACKs carried by data packets */
+extern THREADLOCAL int packets_buffered; /* count of the packets buffered because they arrived out of order */
+
+/* statistics updated by the send queue */
+extern THREADLOCAL int messages_queued;    /* count of the messages queued because the window was full */
+extern THREADLOCAL int sendqueue_maxdepth; /* the largest number of messages queued at one time */
+extern THREADLOCAL double sendqueue_delay; /* total time messages spent waiting in the send queue */
+
+#define   A    0
+#define   B    1
+
+/* a "msg" is the data unit passed from layer 5 (teachers code) to layer  */
+/* 4 (students' code).  It contains the data (characters) to be delivered */
+/* to layer 5 via the students transport level protocol entities.         */
+#define MSGSIZE 20
+struct msg {
+  char data[MSGSIZE];
+};
+
+/* a packet is the data unit passed from layer 4 (students code) to layer */
+/* 3 (teachers code).  Note the pre-defined packet structure, which all   */
+/* students must follow.  Only the first length bytes of the payload are  */
+/* carried across the network, so several messages can share a packet.   */
+#define MAXPAYLOAD 1460
+struct pkt {
+  int seqnum;
+  int acknum;
+  int checksum;
+  int length;               /* number of payload bytes in use */
+  char payload[MAXPAYLOAD];
+};
+
+/* size of the packet header, the mtu option counts header and payload */
+#define PKTHEADER ((int)(4 * sizeof(int)))
+
+/* Packets and messages are passed by pointer.  tolayer3() copies the
+   packet into a buffer owned by the emulator, so the caller may reuse its
+   packet as soon as tolayer3() returns.  The packet given to A_input() and
+   B_input() belongs to the emulator and is only valid until they return. */
+
+/* send to A or B (int), packet to send */
+extern void tolayer3(int, const struct pkt *);  
+
+/* deliver to A or B (int), data to deliver */
+extern void tolayer5(int, const char[MSGSIZE]); 
+
+/* start timer at A or B (int), increment */
+extern void starttimer(int, double);       
+
+/* stop timer at A or B (int) */
+extern void stoptimer(int);               
+
+/* current simulation time */
+extern float get_sim_time(void);
+
+/* A or B (int) asks layer 5 to hold back (1) or resume (0) new messages */
+extern void layer5_backpressure(int, int);
+
+/* The emulator can run several flows, each an A/B pair with its own
+   protocol state, sharing the channel.  A_init() and B_init() are called
+   once per flow, and every routine above acts on the A or B of the flow
+   whose event is being handled, current_flow(), from 0 to flow_count()-1. */
+extern int flow_count(void);
+extern int current_flow(void);
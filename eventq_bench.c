@@ -0,0 +1,789 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+/* ******************************************************************
+   Event list microbenchmark.  Runs the same workloads against several
+   event list structures and reports, for each, the nanoseconds per
+   insert, pop and cancel, the cache misses per operation (from
+   perf_event_open(), when the kernel lets us count them) and the bytes
+   per event held.
+
+   The hold workload keeps the list at a fixed size: each step pops the
+   next event and schedules a packet arrival in its place, or starts a
+   timeout's timer again.  Half the steps also stop the oldest running
+   timer and start one TIMEOUT ahead, as an acknowledgement does.  The packet is
+   scheduled either at now + 1..10 ("hold", the classic hold model), or
+   1..10 after the last arrival on the channel ("channel"), as the
+   emulator's FIFO channel does, with timers TIMEOUT after that, so most
+   inserts land near the tail.
+   A recorded trace, written by the emulator's eventlog option, is
+   replayed as it is.
+
+     gcc -std=c99 -O2 -o eventq_bench eventq_bench.c -lm
+     ./eventq_bench [steps per run, default 1000000] [eventlog file]
+**********************************************************************/
+
+#define TIMEOUT 16.0
+#define MAXSIZE 1000000
+#define LISTMAX 10000       /* the lists are too slow for more */
+
+/* an event, with the fields every structure needs.  Each structure
+   says how many of these bytes it uses. */
+struct node {
+  double t;                 /* event time */
+  unsigned long seq;        /* order of insertion, later events first on a tie */
+  int idx;                  /* heaps: position in the heap; calendar: bucket */
+  int timer;                /* the event is a timer */
+  struct node *prev, *next; /* lists and calendar buckets */
+};
+
+/* the order the emulator's event list gives: by time, newest first on a tie */
+static inline int before(const struct node *p, const struct node *q)
+{
+  return p->t < q->t || (p->t == q->t && p->seq > q->seq);
+}
+
+struct queue {
+  const char *name;
+  void (*init)(void);
+  void (*insert)(struct node *);
+  struct node *(*pop)(void);
+  void (*cancel)(struct node *);
+  size_t (*bytes)(void);    /* memory of the structure itself, not the events */
+  size_t nodebytes;         /* bytes of each event the structure uses */
+  int maxsize;              /* the largest list it is run with */
+};
+
+static void *grow(void *p, size_t size, const char *what)
+{
+  p = realloc(p, size);
+  if (p == NULL) {
+    printf("memory allocation for %s failed.", what);
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+/********************** sorted doubly linked lists ***********************/
+
+static struct node *head, *tail;
+
+static void list_init(void)
+{
+  head = tail = NULL;
+}
+
+static void list_link(struct node *p, struct node *q)
+{
+  /* put p after q, or first if q is NULL */
+  p->prev = q;
+  p->next = q != NULL ? q->next : head;
+  if (p->next != NULL)
+    p->next->prev = p;
+  else
+    tail = p;
+  if (q != NULL)
+    q->next = p;
+  else
+    head = p;
+}
+
+/* the original event list: searched from the head */
+static void listhead_insert(struct node *p)
+{
+  struct node *q = NULL, *r;
+
+  for (r = head; r != NULL && before(r, p); r = r->next)
+    q = r;
+  list_link(p, q);
+}
+
+/* searched from the tail, where most new events go */
+static void listtail_insert(struct node *p)
+{
+  struct node *q;
+
+  for (q = tail; q != NULL && before(p, q); q = q->prev)
+    ;
+  list_link(p, q);
+}
+
+static void list_cancel(struct node *p)
+{
+  if (p->prev != NULL)
+    p->prev->next = p->next;
+  else
+    head = p->next;
+  if (p->next != NULL)
+    p->next->prev = p->prev;
+  else
+    tail = p->prev;
+}
+
+static struct node *list_pop(void)
+{
+  struct node *p = head;
+
+  if (p != NULL)
+    list_cancel(p);
+  return p;
+}
+
+static size_t list_bytes(void)
+{
+  return 0;
+}
+
+/********************** d-ary heaps ***********************/
+
+static struct node **heap;
+static int heapn, heapmax;
+
+static void heap_init(void)
+{
+  free(heap);
+  heap = NULL;
+  heapn = heapmax = 0;
+}
+
+static size_t heap_bytes(void)
+{
+  return heapmax * sizeof(struct node *);
+}
+
+static inline void place(struct node *p, int i)
+{
+  heap[i] = p;
+  p->idx = i;
+}
+
+/* D children per node, the emulator's heap is D = 2 */
+#define HEAP(D)                                                         \
+static void siftup##D(int i)                                            \
+{                                                                       \
+  struct node *p = heap[i];                                             \
+                                                                        \
+  while (i > 0 && before(p, heap[(i - 1) / D])) {                       \
+    place(heap[(i - 1) / D], i);                                        \
+    i = (i - 1) / D;                                                    \
+  }                                                                     \
+  place(p, i);                                                          \
+}                                                                       \
+                                                                        \
+static void siftdown##D(int i)                                          \
+{                                                                       \
+  struct node *p = heap[i];                                             \
+  int child, c, last;                                                   \
+                                                                        \
+  while ((child = D * i + 1) < heapn) {                                 \
+    last = child + D < heapn ? child + D : heapn;                       \
+    for (c = child + 1; c < last; c++)                                  \
+      if (before(heap[c], heap[child]))                                 \
+        child = c;                                                      \
+    if (!before(heap[child], p))                                        \
+      break;                                                            \
+    place(heap[child], i);                                              \
+    i = child;                                                          \
+  }                                                                     \
+  place(p, i);                                                          \
+}                                                                       \
+                                                                        \
+static void heap##D##_insert(struct node *p)                            \
+{                                                                       \
+  if (heapn == heapmax) {                                               \
+    heapmax = heapmax ? 2 * heapmax : 64;                               \
+    heap = grow(heap, heapmax * sizeof(struct node *), "heap");         \
+  }                                                                     \
+  place(p, heapn++);                                                    \
+  siftup##D(heapn - 1);                                                 \
+}                                                                       \
+                                                                        \
+static void heap##D##_cancel(struct node *p)                            \
+{                                                                       \
+  int i = p->idx;                                                       \
+                                                                        \
+  heapn--;                                                              \
+  if (i == heapn)                                                       \
+    return;                                                             \
+  place(heap[heapn], i);                                                \
+  siftdown##D(i);                                                       \
+  siftup##D(heap[i]->idx);                                              \
+}                                                                       \
+                                                                        \
+static struct node *heap##D##_pop(void)                                 \
+{                                                                       \
+  struct node *p;                                                       \
+                                                                        \
+  if (heapn == 0)                                                       \
+    return NULL;                                                        \
+  p = heap[0];                                                          \
+  heap##D##_cancel(p);                                                  \
+  return p;                                                             \
+}
+
+HEAP(2)
+HEAP(4)
+
+/********************** calendar queue ***********************/
+
+/* Brown's calendar queue: a year of nbuckets days, each width long, and
+   each day a sorted list of its events from every year.  Popping walks
+   the days from the current one; the calendar is rebuilt with twice or
+   half the days when the list grows or shrinks past them. */
+struct bucket {
+  struct node *first, *last;
+};
+
+static struct bucket *days;
+static int ndays, calsize, today;
+static double width, dayend;       /* day length and the end of today */
+static int resizing;
+
+static void cal_setup(int n, double w, double start);
+
+static void cal_init(void)
+{
+  calsize = 0;
+  resizing = 0;
+  cal_setup(2, 1.0, 0.0);
+}
+
+static size_t cal_bytes(void)
+{
+  return ndays * sizeof(struct bucket);
+}
+
+static void cal_add(struct node *p)
+{
+  struct bucket *b;
+  struct node *q;
+  int d = (int)((long)(p->t / width) & (ndays - 1));
+
+  /* from the end of the day, as most events are the latest */
+  b = &days[d];
+  for (q = b->last; q != NULL && before(p, q); q = q->prev)
+    ;
+  p->idx = d;
+  p->prev = q;
+  p->next = q != NULL ? q->next : b->first;
+  if (p->next != NULL)
+    p->next->prev = p;
+  else
+    b->last = p;
+  if (q != NULL)
+    q->next = p;
+  else
+    b->first = p;
+}
+
+static void cal_unlink(struct node *p)
+{
+  struct bucket *b = &days[p->idx];
+
+  if (p->prev != NULL)
+    p->prev->next = p->next;
+  else
+    b->first = p->next;
+  if (p->next != NULL)
+    p->next->prev = p->prev;
+  else
+    b->last = p->prev;
+}
+
+static void cal_setup(int n, double w, double start)
+{
+  days = grow(days, n * sizeof(struct bucket), "calendar");
+  memset(days, 0, n * sizeof(struct bucket));
+  ndays = n;
+  width = w;
+  today = (int)((long)(start / width) & (ndays - 1));
+  dayend = (floor(start / width) + 1.0) * width;
+}
+
+/* rebuild the calendar with n days, a day about three times the mean
+   gap between events */
+static void cal_resize(int n)
+{
+  struct node *all = NULL, *p, *next;
+  double lo = INFINITY, hi = -INFINITY, w;
+  int i;
+
+  /* each day's events go back in in order, so each goes on the end */
+  for (i = 0; i < ndays; i++)
+    for (p = days[i].last; p != NULL; p = next) {
+      next = p->prev;
+      p->next = all;
+      all = p;
+      if (p->t < lo)
+        lo = p->t;
+      if (p->t > hi)
+        hi = p->t;
+    }
+  w = calsize > 1 && hi > lo ? 3.0 * (hi - lo) / calsize : width;
+  cal_setup(n, w, lo < INFINITY ? lo : 0.0);
+  for (p = all; p != NULL; p = next) {
+    next = p->next;
+    cal_add(p);
+  }
+}
+
+static void cal_insert(struct node *p)
+{
+  cal_add(p);
+  if (p->t < dayend - width) {
+    /* earlier than today, start again from its day */
+    today = p->idx;
+    dayend = (floor(p->t / width) + 1.0) * width;
+  }
+  if (++calsize > 2 * ndays && ndays < (1 << 30))
+    cal_resize(2 * ndays);
+}
+
+static void cal_cancel(struct node *p)
+{
+  cal_unlink(p);
+  if (--calsize < ndays / 2 && ndays > 2)
+    cal_resize(ndays / 2);
+}
+
+static struct node *cal_pop(void)
+{
+  struct node *p, *best = NULL;
+  int i, d;
+
+  if (calsize == 0)
+    return NULL;
+  for (i = 0; i < ndays; i++) {
+    d = (today + i) & (ndays - 1);
+    p = days[d].first;
+    if (p != NULL && p->t < dayend) {
+      today = d;
+      cal_cancel(p);
+      return p;
+    }
+    dayend += width;
+  }
+  /* nothing this year, jump to the earliest event */
+  for (i = 0; i < ndays; i++)
+    if (days[i].first != NULL && (best == NULL || before(days[i].first, best)))
+      best = days[i].first;
+  today = best->idx;
+  dayend = (floor(best->t / width) + 1.0) * width;
+  cal_cancel(best);
+  return best;
+}
+
+static const struct queue queues[] = {
+  { "list-head", list_init, listhead_insert, list_pop, list_cancel, list_bytes,
+    offsetof(struct node, idx) + 2 * sizeof(struct node *), LISTMAX },
+  { "list-tail", list_init, listtail_insert, list_pop, list_cancel, list_bytes,
+    offsetof(struct node, idx) + 2 * sizeof(struct node *), LISTMAX },
+  { "heap2", heap_init, heap2_insert, heap2_pop, heap2_cancel, heap_bytes,
+    offsetof(struct node, idx) + sizeof(int), MAXSIZE },
+  { "heap4", heap_init, heap4_insert, heap4_pop, heap4_cancel, heap_bytes,
+    offsetof(struct node, idx) + sizeof(int), MAXSIZE },
+  { "calendar", cal_init, cal_insert, cal_pop, cal_cancel, cal_bytes,
+    offsetof(struct node, idx) + sizeof(int) + 2 * sizeof(struct node *), MAXSIZE },
+};
+#define NQUEUES (int)(sizeof(queues) / sizeof(queues[0]))
+
+/********************** timing and counting ***********************/
+
+static double now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* a cheap clock for timing single operations: the time stamp counter
+   where there is one, otherwise the monotonic clock in nanoseconds */
+static inline uint64_t ticks(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  uint32_t lo, hi;
+
+  __asm__ __volatile__("rdtsc" : "=a"(lo), "=d"(hi));
+  return ((uint64_t)hi << 32) | lo;
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+static double nspertick;           /* nanoseconds per tick */
+static double tickcost;            /* ticks taken by reading the clock twice */
+
+static void calibrate(void)
+{
+  uint64_t t0, t1, sum = 0;
+  double start;
+  int i;
+
+  start = now();
+  t0 = ticks();
+  while (now() - start < 0.05)
+    ;
+  t1 = ticks();
+  nspertick = (now() - start) * 1e9 / (double)(t1 - t0);
+  for (i = 0; i < 100000; i++) {
+    t0 = ticks();
+    t1 = ticks();
+    sum += t1 - t0;
+  }
+  tickcost = (double)sum / 100000;
+}
+
+static int perffd = -1;
+
+/* count this process's cache misses, if the kernel allows it */
+static void perf_init(void)
+{
+  struct perf_event_attr attr;
+
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  perffd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  if (perffd < 0)
+    printf("cache misses are not counted: perf_event_open failed\n");
+}
+
+static void perf_start(void)
+{
+  if (perffd >= 0) {
+    ioctl(perffd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(perffd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+/* the cache misses since perf_start(), or -1 */
+static long long perf_stop(void)
+{
+  long long count;
+
+  if (perffd < 0)
+    return -1;
+  ioctl(perffd, PERF_EVENT_IOC_DISABLE, 0);
+  if (read(perffd, &count, sizeof(count)) != sizeof(count))
+    return -1;
+  return count;
+}
+
+/********************** workloads ***********************/
+
+enum { OP_INSERT, OP_POP, OP_CANCEL, NOPS };
+
+struct result {
+  long ops[NOPS];
+  double ticks[NOPS];       /* timed run: ticks spent in each operation */
+  double elapsed;           /* untimed run: seconds */
+  long long misses;         /* untimed run: cache misses, or -1 */
+  size_t bytes;             /* the structure's memory at the end */
+  unsigned long check;      /* a hash of the order events came out in */
+};
+
+static struct node *nodes;
+static unsigned long nextseq;
+static unsigned rng;
+
+static double uniform(void)
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng / 4294967296.0;
+}
+
+/* run op on q, timing it if timed */
+#define RUN(r, timed, op, call)                                         \
+  do {                                                                  \
+    if (timed) {                                                        \
+      uint64_t t0_ = ticks();                                           \
+      call;                                                             \
+      (r)->ticks[op] += ticks() - t0_;                                  \
+    } else                                                              \
+      call;                                                             \
+    (r)->ops[op]++;                                                     \
+  } while (0)
+
+
+/* the free events, and the timers oldest first.  A timer that went off
+   stays in the ring, marked, until the ring gets to it. */
+static struct node **freelist, **timers;
+static int nfree, nnodes, tfirst, tcount;
+
+static struct node *take(double t, int timer)
+{
+  struct node *p = freelist[--nfree];
+
+  p->t = t;
+  p->seq = nextseq++;
+  p->timer = timer;
+  return p;
+}
+
+static void addtimer(struct node *p)
+{
+  timers[(tfirst + tcount++) % nnodes] = p;
+}
+
+static struct node *oldesttimer(void)
+{
+  struct node *p;
+
+  while (tcount > 0) {
+    p = timers[tfirst];
+    tfirst = (tfirst + 1) % nnodes;
+    tcount--;
+    if (p->timer == 1)
+      return p;
+    freelist[nfree++] = p;
+  }
+  return NULL;
+}
+
+/* hold workload with size events for steps steps.  channel schedules
+   packets after the last one on the channel instead of after now. */
+static void hold(const struct queue *q, int size, long steps, int channel, int timed, struct result *r)
+{
+  struct node *p;
+  double start, t, last = 0.0;
+  long s;
+  int i;
+
+  rng = 2463534242u;
+  nextseq = 0;
+  nfree = 0;
+  for (i = nnodes - 1; i >= 0; i--)
+    freelist[nfree++] = &nodes[i];
+  tfirst = tcount = 0;
+  q->init();
+
+  /* every tenth event is a timer, for the packet before it on the
+     channel, or going off over the first TIMEOUT */
+  for (i = 0; i < size; i++) {
+    last += 1.0 + 9.0 * uniform();
+    if (i % 10 == 0) {
+      p = take(channel ? last + TIMEOUT : TIMEOUT * i / size, 1);
+      addtimer(p);
+    } else
+      p = take(channel ? last : 10.0 * uniform(), 0);
+    q->insert(p);
+  }
+
+  perf_start();
+  start = now();
+  for (s = 0; s < steps; s++) {
+    RUN(r, timed, OP_POP, p = q->pop());
+    r->check = r->check * 31 + p->seq;
+    t = p->t;
+    if (p->timer) {
+      /* a timeout: the timer is started again */
+      p->timer = 2;            /* freed when the ring gets to it */
+      p = take((channel ? last : t) + TIMEOUT, 1);
+      addtimer(p);
+    } else {
+      freelist[nfree++] = p;
+      last = (channel && last > t ? last : t) + 1.0 + 9.0 * uniform();
+      p = take(last, 0);
+    }
+    RUN(r, timed, OP_INSERT, q->insert(p));
+    /* half the time a packet is acknowledged: its timer is stopped and
+       the next packet's started */
+    if (uniform() < 0.5 && (p = oldesttimer()) != NULL) {
+      RUN(r, timed, OP_CANCEL, q->cancel(p));
+      freelist[nfree++] = p;
+      p = take((channel ? last : t) + TIMEOUT, 1);
+      addtimer(p);
+      RUN(r, timed, OP_INSERT, q->insert(p));
+    }
+  }
+  r->elapsed = now() - start;
+  r->misses = perf_stop();
+  r->bytes = q->bytes();
+}
+
+/* a trace from the emulator's eventlog option: "i TIME" inserts an event,
+   "p" pops the next one and "c K" cancels the event inserted Kth */
+struct op {
+  int op;
+  long arg;                 /* the insert's event, or the event to cancel */
+};
+
+static struct op *trace;
+static long ntrace, ntraceinserts;
+static double *tracetimes;
+static int tracesize;       /* the longest the list gets */
+
+static void readtrace(const char *path)
+{
+  FILE *fp = fopen(path, "r");
+  char line[64];
+  long max = 0, k;
+  int size = 0;
+
+  if (fp == NULL) {
+    perror(path);
+    exit(EXIT_FAILURE);
+  }
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    if (ntrace == max) {
+      max = max ? 2 * max : 4096;
+      trace = grow(trace, max * sizeof(struct op), "trace");
+      tracetimes = grow(tracetimes, max * sizeof(double), "trace");
+    }
+    if (line[0] == 'i') {
+      trace[ntrace].op = OP_INSERT;
+      trace[ntrace].arg = ntraceinserts;
+      tracetimes[ntraceinserts++] = atof(line + 1);
+      if (++size > tracesize)
+        tracesize = size;
+    } else if (line[0] == 'p') {
+      trace[ntrace].op = OP_POP;
+      size--;
+    } else if (line[0] == 'c' && (k = atol(line + 1)) >= 0 && k < ntraceinserts) {
+      trace[ntrace].op = OP_CANCEL;
+      trace[ntrace].arg = k;
+      size--;
+    } else
+      continue;
+    ntrace++;
+  }
+  fclose(fp);
+}
+
+static void replay(const struct queue *q, int timed, struct result *r)
+{
+  struct node *p, *events;
+  double start;
+  long i;
+
+  events = grow(NULL, (ntraceinserts + 1) * sizeof(struct node), "trace events");
+  q->init();
+  perf_start();
+  start = now();
+  for (i = 0; i < ntrace; i++)
+    switch (trace[i].op) {
+    case OP_INSERT:
+      p = &events[trace[i].arg];
+      p->t = tracetimes[trace[i].arg];
+      p->seq = trace[i].arg;
+      RUN(r, timed, OP_INSERT, q->insert(p));
+      break;
+    case OP_POP:
+      RUN(r, timed, OP_POP, p = q->pop());
+      if (p != NULL)
+        r->check = r->check * 31 + p->seq;
+      break;
+    default:
+      RUN(r, timed, OP_CANCEL, q->cancel(&events[trace[i].arg]));
+    }
+  r->elapsed = now() - start;
+  r->misses = perf_stop();
+  r->bytes = q->bytes();
+  free(events);
+}
+
+/********************** reporting ***********************/
+
+static void nsper(const struct result *r, int op)
+{
+  if (r->ops[op] == 0)
+    printf(" %8s", "-");
+  else
+    /* less the cost of reading the clock, which can leave a little below 0 */
+    printf(" %8.1f", fmax(0.0, (r->ticks[op] / r->ops[op] - tickcost) * nspertick));
+}
+
+/* run queue q once untimed, for the throughput and cache misses, and
+   once timing each operation */
+static void bench(const char *workload, const struct queue *q, int size, long steps, int channel,
+                  unsigned long *check)
+{
+  struct result plain, timed;
+  long ops;
+
+  memset(&plain, 0, sizeof(plain));
+  memset(&timed, 0, sizeof(timed));
+  if (workload[0] == 't') {
+    replay(q, 0, &plain);
+    replay(q, 1, &timed);
+  } else {
+    hold(q, size, steps, channel, 0, &plain);
+    hold(q, size, steps, channel, 1, &timed);
+  }
+  ops = plain.ops[OP_INSERT] + plain.ops[OP_POP] + plain.ops[OP_CANCEL];
+  printf("%-8s %8d %-10s", workload, size, q->name);
+  nsper(&timed, OP_INSERT);
+  nsper(&timed, OP_POP);
+  nsper(&timed, OP_CANCEL);
+  printf(" %8.1f", plain.elapsed * 1e9 / ops);
+  if (plain.misses >= 0)
+    printf(" %8.3f", (double)plain.misses / ops);
+  else
+    printf(" %8s", "n/a");
+  printf(" %8.1f", q->nodebytes + (double)plain.bytes / size);
+  /* every structure must give the events in the same order */
+  if (*check == 0)
+    *check = plain.check;
+  if (plain.check != *check || timed.check != *check)
+    printf("  wrong order");
+  printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+  static const char *const workloads[] = { "hold", "channel" };
+  long steps = argc > 1 ? atol(argv[1]) : 1000000, n;
+  unsigned long check;
+  int w, size, i;
+
+  if (steps <= 0)
+    steps = 1000000;
+  calibrate();
+  perf_init();
+  nnodes = 2 * MAXSIZE + 16;
+  nodes = grow(NULL, nnodes * sizeof(struct node), "events");
+  freelist = grow(NULL, nnodes * sizeof(struct node *), "events");
+  timers = grow(NULL, nnodes * sizeof(struct node *), "timers");
+
+  printf("%-8s %8s %-10s %8s %8s %8s %8s %8s %8s\n", "workload", "size", "queue",
+         "insert", "pop", "cancel", "ns/op", "miss/op", "B/event");
+  for (w = 0; w < 2; w++)
+    for (size = 10; size <= MAXSIZE; size *= 10) {
+      check = 0;
+      /* the lists take time in proportion to the size, so all the
+         structures take fewer steps where the lists run */
+      n = size > 1000 && size <= LISTMAX ? steps / (size / 1000) : steps;
+      for (i = 0; i < NQUEUES; i++)
+        if (size <= queues[i].maxsize)
+          bench(workloads[w], &queues[i], size, n, w, &check);
+    }
+
+  if (argc > 2) {
+    readtrace(argv[2]);
+    check = 0;
+    for (i = 0; i < NQUEUES; i++)
+      if (tracesize <= queues[i].maxsize)
+        bench("trace", &queues[i], tracesize > 0 ? tracesize : 1, 0, 0, &check);
+  }
+  return EXIT_SUCCESS;
+}
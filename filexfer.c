@@ -0,0 +1,167 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "emulator.h"
+#include "options.h"
+#include "checksum.h"
+#include "filexfer.h"
+
+/* ******************************************************************
+   File transfer at layer 5.  Both files are mapped rather than read or
+   written, so chunks are copied straight between the messages and the
+   page cache.  B keeps a count per chunk instead of a bitmap: flows run
+   by the parallel engine deliver different chunks at the same time, and
+   a byte of their own can be updated without a lock.
+**********************************************************************/
+
+static const char *sendpath, *recvpath;
+static const char *in;            /* the mapped file being sent */
+static char *out;                 /* the mapped file being received */
+static size_t size;               /* bytes in the file */
+static int nchunks;
+static unsigned char *seen;       /* times each chunk was delivered, up to 255 */
+static int stray;                 /* chunks delivered with a number out of range */
+static struct timespec began;
+
+bool file_enabled(void)
+{
+  static int enabled = -1;      /* not looked up yet */
+
+  if (enabled < 0)
+    enabled = option_string("sendfile", "")[0] != '\0';
+  return enabled;
+}
+
+/* map size bytes of the file open on fd, or stop */
+static void *mapfile(int fd, int prot, const char *path)
+{
+  void *p;
+
+  if (size == 0)
+    return NULL;
+  p = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    printf("can not map file %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+void file_init(bool sending, bool receiving)
+{
+  struct stat st;
+  int fd;
+
+  sendpath = option_string("sendfile", "");
+  recvpath = option_string("recvfile", "received.bin");
+  fd = open(sendpath, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    printf("can not read file %s\n", sendpath);
+    exit(EXIT_FAILURE);
+  }
+  size = st.st_size;
+  nchunks = (int)((size + FILECHUNK - 1) / FILECHUNK);
+  /* B reads the original as well, for its checksum at the end */
+  in = mapfile(fd, PROT_READ, sendpath);
+  if (in != NULL && sending)
+    posix_madvise((void *)in, size, POSIX_MADV_SEQUENTIAL);
+  close(fd);
+
+  if (receiving) {
+    fd = open(recvpath, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, size) < 0) {
+      printf("can not create file %s\n", recvpath);
+      exit(EXIT_FAILURE);
+    }
+    out = mapfile(fd, PROT_READ | PROT_WRITE, recvpath);
+    close(fd);
+    seen = calloc(nchunks + 1, 1);
+    if (seen == NULL) {
+      printf("memory allocation for file transfer failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &began);
+}
+
+int file_chunks(void)
+{
+  return nchunks;
+}
+
+void file_message(int chunk, struct msg *message)
+{
+  size_t off = (size_t)chunk * FILECHUNK;
+  size_t n = size - off < FILECHUNK ? size - off : FILECHUNK;
+
+  memcpy(message->data, &chunk, sizeof(int));
+  memcpy(message->data + sizeof(int), in + off, n);
+  memset(message->data + sizeof(int) + n, 0, FILECHUNK - n);
+}
+
+void file_deliver(const char data[MSGSIZE])
+{
+  size_t off, n;
+  int chunk;
+
+  memcpy(&chunk, data, sizeof(int));
+  if (chunk < 0 || chunk >= nchunks) {
+    stray++;
+    return;
+  }
+  off = (size_t)chunk * FILECHUNK;
+  n = size - off < FILECHUNK ? size - off : FILECHUNK;
+  memcpy(out + off, data + sizeof(int), n);
+  if (seen[chunk] < 255)
+    seen[chunk]++;
+}
+
+/* the CRC-32C of len bytes at data, with the fastest kernel the CPU has */
+static uint32_t filehash(const void *data, size_t len)
+{
+  int k = KERNEL_NKERNELS - 1;
+
+  while (k > KERNEL_PORTABLE && !checksum_kernel_supported((enum checksum_kernel)k))
+    k--;
+  return len == 0 ? 0 : checksum_buffer(CHECKSUM_CRC32C, (enum checksum_kernel)k, data, len);
+}
+
+void file_report(double seconds, double simtime)
+{
+  struct timespec now;
+  uint32_t sent, got;
+  int i, delivered = 0, duplicates = 0;
+  double bytes;
+
+  if (seconds <= 0.0) {
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    seconds = (now.tv_sec - began.tv_sec) + (now.tv_nsec - began.tv_nsec) / 1e9;
+  }
+  for (i = 0; i < nchunks; i++)
+    if (seen[i] > 0) {
+      delivered++;
+      duplicates += seen[i] - 1;
+    }
+  bytes = delivered == nchunks ? (double)size : (double)delivered * FILECHUNK;
+  if (out != NULL)
+    msync(out, size, MS_SYNC);
+  sent = filehash(in, size);
+  got = filehash(out, size);
+
+  printf("file %s:  %lu bytes in %d chunks \n", sendpath, (unsigned long)size, nchunks);
+  printf("file chunks delivered:  %d \n", delivered);
+  if (duplicates > 0 || stray > 0)
+    printf("file chunks delivered twice or out of range:  %d \n", duplicates + stray);
+  printf("CRC-32C of sent file:  %08x, of received file %s:  %08x %s\n", (unsigned)sent, recvpath,
+         (unsigned)got, sent == got && delivered == nchunks ? "(match)" : "(MISMATCH)");
+  printf("file goodput (MB per second of wall-clock time):  %f \n", seconds > 0.0 ? bytes / 1e6 / seconds : 0.0);
+  if (simtime > 0.0)
+    printf("file goodput (bytes per time unit):  %f \n", bytes / simtime);
+}
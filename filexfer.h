@@ -0,0 +1,31 @@
+/* a layer 5 application that moves a real file, turned on with the
+   sendfile option.  A maps the file into memory and sends it a chunk of
+   FILECHUNK bytes per message, with the chunk's number in front of it.
+   B writes every chunk it is given at its place in the file named by
+   the recvfile option (default received.bin), which is made full size
+   up front and mapped into memory.  At the end the CRC-32C of the whole
+   received file is checked against the original's and the goodput is
+   reported.  B finds the file's size from sendfile, so both sides must
+   be able to read it. */
+
+#define FILECHUNK (MSGSIZE - (int)sizeof(int))
+
+/* whether the sendfile option is given */
+extern bool file_enabled(void);
+
+/* map the file to send, the file to receive into, or both */
+extern void file_init(bool sending, bool receiving);
+
+/* the number of messages the file takes */
+extern int file_chunks(void);
+
+/* fill message with chunk number chunk of the file */
+extern void file_message(int chunk, struct msg *message);
+
+/* write the chunk carried by a message delivered at B */
+extern void file_deliver(const char data[MSGSIZE]);
+
+/* finish the received file and print what arrived, its checksum and
+   the goodput over seconds of wall-clock time (0 for the time since
+   file_init()) and, if simtime is above 0, over simtime time units */
+extern void file_report(double seconds, double simtime);
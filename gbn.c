@@ -1,275 +1,600 @@
-#include <stdlib.h>
-#include <stdio.h>
-#include <stdbool.h>
-#include "emulator.h"
-#include "gbn.h"
-
-/* ******************************************************************
-   Go Back N protocol.  Adapted from J.F.Kurose
-   ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.2  
-
-   Network properties:
-   - one way network delay averages five time units (longer if there
-   are other messages in the channel for GBN), but can be larger
-   - packets can be corrupted (either the header or the data portion)
-   or lost, according to user-defined probabilities
-   - packets will be delivered in the order in which they were sent
-   (although some can be lost).
-
-   Modifications: 
-   - removed bidirectional GBN code and other code not used by prac. 
-   - fixed C style to adhere to current programming style
-   - added GBN implementation
-**********************************************************************/
-
-#define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
-#define WINDOWSIZE 6    /* the maximum number of buffered unacked packet */
-#define SEQSPACE 7      /* the min sequence space for GBN must be at least windowsize + 1 */
-#define NOTINUSE (-1)   /* used to fill header fields that are not being used */
-
-/* generic procedure to compute the checksum of a packet.  Used by both sender and receiver  
-   the simulator will overwrite part of your packet with 'z's.  It will not overwrite your 
-   original checksum.  This procedure must generate a different checksum to the original if
-   the packet is corrupted.
-*/
-int ComputeChecksum(struct pkt packet)
-{
-  int checksum = 0;
-  int i;
-
-  checksum = packet.seqnum;
-  checksum += packet.acknum;
-  for ( i=0; i<20; i++ ) 
-    checksum += (int)(packet.payload[i]);
-
-  return checksum;
-}
-
-bool IsCorrupted(struct pkt packet)
-{
-  if (packet.checksum == ComputeChecksum(packet))
-    return (false);
-  else
-    return (true);
-}
-
-
-/********* Sender (A) variables and functions ************/
-
-static struct pkt buffer[WINDOWSIZE];  /* array for storing packets waiting for ACK */
-static int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
-static int windowcount;                /* the number of packets currently awaiting an ACK */
-static int A_nextseqnum;               /* the next sequence number to be used by the sender */
-
-/* called from layer 5 (application layer), passed the message to be sent to other side */
-void A_output(struct msg message)
-{
-  struct pkt sendpkt;
-  int i;
-
-  /* if not blocked waiting on ACK */
-  if ( windowcount < WINDOWSIZE) {
-    if (TRACE > 1)
-      printf("----A: New message arrives, send window is not full, send new messge to layer3!\n");
-
-    /* create packet */
-    sendpkt.seqnum = A_nextseqnum;
-    sendpkt.acknum = NOTINUSE;
-    for ( i=0; i<20 ; i++ ) 
-      sendpkt.payload[i] = message.data[i];
-    sendpkt.checksum = ComputeChecksum(sendpkt); 
-
-    /* put packet in window buffer */
-    /* windowlast will always be 0 for alternating bit; but not for GoBackN */
-    windowlast = (windowlast + 1) % WINDOWSIZE; 
-    buffer[windowlast] = sendpkt;
-    windowcount++;
-
-    /* send out packet */
-    if (TRACE > 0)
-      printf("Sending packet %d to layer 3\n", sendpkt.seqnum);
-    tolayer3 (A, sendpkt);
-
-    /* start timer if first packet in window */
-    if (windowcount == 1)
-      starttimer(A,RTT);
-
-    /* get next sequence number, wrap back to 0 */
-    A_nextseqnum = (A_nextseqnum + 1) % SEQSPACE;  
-  }
-  /* if blocked,  window is full */
-  else {
-    if (TRACE > 0)
-      printf("----A: New message arrives, send window is full\n");
-    window_full++;
-  }
-}
-
-
-/* called from layer 3, when a packet arrives for layer 4 
-   In this practical this will always be an ACK as B never sends data.
-*/
-void A_input(struct pkt packet)
-{
-  int ackcount = 0;
-  int i;
-
-  /* if received ACK is not corrupted */ 
-  if (!IsCorrupted(packet)) {
-    if (TRACE > 0)
-      printf("----A: uncorrupted ACK %d is received\n",packet.acknum);
-    total_ACKs_received++;
-
-    /* check if new ACK or duplicate */
-    if (windowcount != 0) {
-          int seqfirst = buffer[windowfirst].seqnum;
-          int seqlast = buffer[windowlast].seqnum;
-          /* check case when seqnum has and hasn't wrapped */
-          if (((seqfirst <= seqlast) && (packet.acknum >= seqfirst && packet.acknum <= seqlast)) ||
-              ((seqfirst > seqlast) && (packet.acknum >= seqfirst || packet.acknum <= seqlast))) {
-
-            /* packet is a new ACK */
-            if (TRACE > 0)
-              printf("----A: ACK %d is not a duplicate\n",packet.acknum);
-            new_ACKs++;
-
-            /* cumulative acknowledgement - determine how many packets are ACKed */
-            if (packet.acknum >= seqfirst)
-              ackcount = packet.acknum + 1 - seqfirst;
-            else
-              ackcount = SEQSPACE - seqfirst + packet.acknum;
-
-	    /* slide window by the number of packets ACKed */
-            windowfirst = (windowfirst + ackcount) % WINDOWSIZE;
-
-            /* delete the acked packets from window buffer */
-            for (i=0; i<ackcount; i++)
-              windowcount--;
-
-	    /* start timer again if there are still more unacked packets in window */
-            stoptimer(A);
-            if (windowcount > 0)
-              starttimer(A, RTT);
-
-          }
-        }
-        else
-          if (TRACE > 0)
-        printf ("----A: duplicate ACK received, do nothing!\n");
-  }
-  else 
-    if (TRACE > 0)
-      printf ("----A: corrupted ACK is received, do nothing!\n");
-}
-
-/* called when A's timer goes off */
-void A_timerinterrupt(void)
-{
-  int i;
-
-  if (TRACE > 0)
-    printf("----A: time out,resend packets!\n");
-
-  for(i=0; i<windowcount; i++) {
-
-    if (TRACE > 0)
-      printf ("---A: resending packet %d\n", (buffer[(windowfirst+i) % WINDOWSIZE]).seqnum);
-
-    tolayer3(A,buffer[(windowfirst+i) % WINDOWSIZE]);
-    packets_resent++;
-    if (i==0) starttimer(A,RTT);
-  }
-}       
-
-
-
-/* the following routine will be called once (only) before any other */
-/* entity A routines are called. You can use it to do any initialization */
-void A_init(void)
-{
-  /* initialise A's window, buffer and sequence number */
-  A_nextseqnum = 0;  /* A starts with seq num 0, do not change this */
-  windowfirst = 0;
-  windowlast = -1;   /* windowlast is where the last packet sent is stored.  
-		     new packets are placed in winlast + 1 
-		     so initially this is set to -1
-		   */
-  windowcount = 0;
-}
-
-
-
-/********* Receiver (B)  variables and procedures ************/
-
-static int expectedseqnum; /* the sequence number expected next by the receiver */
-static int B_nextseqnum;   /* the sequence number for the next packets sent by B */
-
-
-/* called from layer 3, when a packet arrives for layer 4 at B*/
-void B_input(struct pkt packet)
-{
-  struct pkt sendpkt;
-  int i;
-
-  /* if not corrupted and received packet is in order */
-  if  ( (!IsCorrupted(packet))  && (packet.seqnum == expectedseqnum) ) {
-    if (TRACE > 0)
-      printf("----B: packet %d is correctly received, send ACK!\n",packet.seqnum);
-    packets_received++;
-
-    /* deliver to receiving application */
-    tolayer5(B, packet.payload);
-
-    /* send an ACK for the received packet */
-    sendpkt.acknum = expectedseqnum;
-
-    /* update state variables */
-    expectedseqnum = (expectedseqnum + 1) % SEQSPACE;        
-  }
-  else {
-    /* packet is corrupted or out of order resend last ACK */
-    if (TRACE > 0) 
-      printf("----B: packet corrupted or not expected sequence number, resend ACK!\n");
-    if (expectedseqnum == 0)
-      sendpkt.acknum = SEQSPACE - 1;
-    else
-      sendpkt.acknum = expectedseqnum - 1;
-  }
-
-  /* create packet */
-  sendpkt.seqnum = B_nextseqnum;
-  B_nextseqnum = (B_nextseqnum + 1) % 2;
-    
-  /* we don't have any data to send.  fill payload with 0's */
-  for ( i=0; i<20 ; i++ ) 
-    sendpkt.payload[i] = '0';  
-
-  /* computer checksum */
-  sendpkt.checksum = ComputeChecksum(sendpkt); 
-
-  /* send out packet */
-  tolayer3 (B, sendpkt);
-}
-
-/* the following routine will be called once (only) before any other */
-/* entity B routines are called. You can use it to do any initialization */
-void B_init(void)
-{
-  expectedseqnum = 0;
-  B_nextseqnum = 1;
-}
-
-/******************************************************************************
- * The following functions need be completed only for bi-directional messages *
- *****************************************************************************/
-
-/* Note that with simplex transfer from a-to-B, there is no B_output() */
-void B_output(struct msg message)  
-{
-}
-
-/* called when B's timer goes off */
-void B_timerinterrupt(void)
-{
-}
-
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "emulator.h"
+#include "gbn.h"
+#include "options.h"
+#include "sendqueue.h"
+#include "checksum.h"
+#include "checkpoint.h"
+
+/* ******************************************************************
+   Go Back N protocol.  Adapted from J.F.Kurose
+   ALTERNATING BIT AND GO-BACK-N NETWORK EMULATOR: VERSION 1.2  
+
+   Network properties:
+   - one way network delay averages five time units (longer if there
+   are other messages in the channel for GBN), but can be larger
+   - packets can be corrupted (either the header or the data portion)
+   or lost, according to user-defined probabilities
+   - packets will be delivered in the order in which they were sent
+   (although some can be lost).
+
+   Modifications: 
+   - removed bidirectional GBN code and other code not used by prac. 
+   - fixed C style to adhere to current programming style
+   - added GBN implementation
+   - added bidirectional transfer: A and B each have a sender and a
+   receiver, and ACKs ride on data packets going the other way
+**********************************************************************/
+
+#define RTT  16.0       /* round trip time.  MUST BE SET TO 16.0 when submitting assignment */
+#ifndef WINDOWSIZE      /* or -DWINDOWSIZE=N when building */
+#define WINDOWSIZE 6    /* the maximum number of buffered unacked packet */
+#endif
+#define SEQSPACE (WINDOWSIZE + 1) /* the min sequence space for GBN must be at least windowsize + 1 */
+#define NOTINUSE (-1)   /* used to fill header fields that are not being used */
+
+/* generic procedure to compute the checksum of a packet.  Used by both sender and receiver  
+   the simulator will overwrite part of your packet with 'z's.  It will not overwrite your 
+   original checksum.  This procedure must generate a different checksum to the original if
+   the packet is corrupted.
+*/
+int ComputeChecksum(const struct pkt *packet)
+{
+  /* the algorithm is chosen with the checksum option, see checksum.h */
+  return checksum_packet(packet);
+}
+
+bool IsCorrupted(const struct pkt *packet)
+{
+  if (packet->length < 0 || packet->length > MAXPAYLOAD)
+    return (true);
+  if (packet->checksum == ComputeChecksum(packet))
+    return (false);
+  else
+    return (true);
+}
+
+
+/* Packets that carry data have a sequence number, packets that carry an ACK
+   have an ACK number.  A packet can be both: when data flows in both directions
+   every data packet carries the receiver's cumulative ACK.  A standalone ACK has
+   seqnum NOTINUSE, data sent from A to B only has acknum NOTINUSE.
+*/
+
+static bool bidirectional;   /* data flows both ways, so data packets carry ACKs */
+static bool piggyback;       /* hold back ACKs that can ride on data soon */
+static float ackdelay;       /* the longest an ACK is held back for piggybacking */
+static int batchmax;         /* the maximum number of messages in one packet */
+static float batchdelay;     /* the longest a partly filled batch is held back */
+
+#define NAME(AorB) ((AorB) == A ? 'A' : 'B')
+
+/* state is kept for every flow the emulator runs, entity 2 * flow + A or B */
+#define ENTITY(AorB) (2 * current_flow() + (AorB))
+
+/* Packets are only ever used up to the largest payload the mtu allows,
+   so the window buffers hold slots of slotsize bytes rather than whole
+   struct pkts.  That keeps the state of tens of thousands of flows small. */
+static int slotsize;
+#define SLOT(x, i) ((struct pkt *)((x)->slots + (i) * slotsize))
+
+/********* Sender variables and functions ************/
+
+struct sender {
+  char *slots;                    /* WINDOWSIZE packets waiting for ACK, see SLOT() */
+  int windowfirst, windowlast;    /* array indexes of the first/last packet awaiting ACK */
+  int windowcount;                /* the number of packets currently awaiting an ACK */
+  int nextseqnum;                 /* the next sequence number to be used by the sender */
+  struct sendqueue sendq;         /* messages waiting for room in the window */
+  int batchlen;                   /* payload bytes collected for the next packet */
+  float batchstart;               /* time the first message was added to the batch */
+};
+
+/********* Receiver variables ************/
+
+struct receiver {
+  int expectedseqnum;             /* the sequence number expected next by the receiver */
+  bool ackowed;                   /* data has arrived that has not been ACKed yet */
+  bool ackpending;                /* that ACK is being held back for piggybacking */
+  float acktime;                  /* when the held back ACK became due */
+};
+
+static struct sender *snd = NULL;   /* indexed by ENTITY(A or B) */
+static struct receiver *rcv = NULL;
+
+static void sendack(int AorB);
+
+/* the cumulative ACK of this side's receiver: the last in order sequence number */
+static int lastinorder(int AorB)
+{
+  return (rcv[ENTITY(AorB)].expectedseqnum + SEQSPACE - 1) % SEQSPACE;
+}
+
+/* put this side's cumulative ACK into a data packet about to be (re)sent */
+static void stampack(int AorB, struct pkt *sendpkt)
+{
+  if (!bidirectional)
+    return;
+  if (rcv[ENTITY(AorB)].ackowed)
+    acks_piggybacked++;
+  rcv[ENTITY(AorB)].ackowed = false;
+  rcv[ENTITY(AorB)].ackpending = false;
+  sendpkt->acknum = lastinorder(AorB);
+  sendpkt->checksum = ComputeChecksum(sendpkt); 
+}
+
+/* send the batched messages as one packet, the window must not be full.
+   The batch is collected in the next free window slot, so the packet is
+   built in place and handed to layer 3 without copying it. */
+static void sendbatch(int AorB)
+{
+  struct sender *s = &snd[ENTITY(AorB)];
+  struct pkt *sendpkt;
+
+  /* put packet in window buffer */
+  /* windowlast will always be 0 for alternating bit; but not for GoBackN */
+  s->windowlast = (s->windowlast + 1) % WINDOWSIZE; 
+  sendpkt = SLOT(s, s->windowlast);
+  s->windowcount++;
+
+  /* create packet */
+  sendpkt->seqnum = s->nextseqnum;
+  sendpkt->acknum = NOTINUSE;
+  sendpkt->length = s->batchlen;
+  sendpkt->checksum = ComputeChecksum(sendpkt); 
+  stampack(AorB, sendpkt);
+  s->batchlen = 0;
+
+  /* send out packet */
+  if (TRACE > 0)
+    printf("Sending packet %d to layer 3\n", sendpkt->seqnum);
+  tolayer3 (AorB, sendpkt);
+
+  /* start timer if first packet in window */
+  if (s->windowcount == 1)
+    starttimer(AorB,RTT);
+
+  /* get next sequence number, wrap back to 0 */
+  s->nextseqnum = (s->nextseqnum + 1) % SEQSPACE;  
+}
+
+/* add a message to the batch and send the batch once it fills a packet */
+static void batch(int AorB, const struct msg *message)
+{
+  struct sender *s = &snd[ENTITY(AorB)];
+  struct pkt *next = SLOT(s, (s->windowfirst + s->windowcount) % WINDOWSIZE);
+  int i;
+
+  if (s->batchlen == 0)
+    s->batchstart = get_sim_time();
+  for ( i=0; i<MSGSIZE ; i++ ) 
+    next->payload[s->batchlen + i] = message->data[i];
+  s->batchlen += MSGSIZE;
+
+  if (s->batchlen >= batchmax * MSGSIZE)
+    sendbatch(AorB);
+}
+
+/* send a partly filled batch unless it may wait for more messages: like Nagle's
+   algorithm a small packet is held while earlier packets are unACKed, but
+   never for longer than batchdelay */
+static void flushbatch(int AorB)
+{
+  struct sender *s = &snd[ENTITY(AorB)];
+
+  if (s->batchlen > 0 && s->windowcount < WINDOWSIZE &&
+      (s->windowcount == 0 || get_sim_time() - s->batchstart >= batchdelay)) {
+    if (TRACE > 1)
+      printf("----%c: sending batch of %d messages\n", NAME(AorB), s->batchlen / MSGSIZE);
+    sendbatch(AorB);
+  }
+}
+
+/* send a held back ACK once it has waited ackdelay, or once no data is left
+   in flight that it could ride on */
+static void flushack(int AorB)
+{
+  struct receiver *r = &rcv[ENTITY(AorB)];
+
+  if (r->ackpending && (snd[ENTITY(AorB)].windowcount == 0 || get_sim_time() - r->acktime >= ackdelay))
+    sendack(AorB);
+}
+
+/* move queued messages into the window as long as there is room */
+static void drainqueue(int AorB)
+{
+  struct sender *s = &snd[ENTITY(AorB)];
+  struct msg message;
+
+  flushbatch(AorB);
+  while (s->windowcount < WINDOWSIZE && sendqueue_get(&s->sendq, &message)) {
+    if (TRACE > 1)
+      printf("----%c: window has room, send queued message to layer3!\n", NAME(AorB));
+    batch(AorB, &message);
+  }
+  flushbatch(AorB);
+
+  /* tell layer 5 whether we can take more messages */
+  layer5_backpressure(AorB, s->windowcount == WINDOWSIZE && sendqueue_full(&s->sendq));
+}
+
+/* called from layer 5 (application layer), passed the message to be sent to other side */
+static void output(int AorB, const struct msg *message)
+{
+  struct sender *s = &snd[ENTITY(AorB)];
+
+  /* if not blocked waiting on ACK */
+  if ( s->windowcount < WINDOWSIZE) {
+    if (TRACE > 1)
+      printf("----%c: New message arrives, send window is not full, send new messge to layer3!\n", NAME(AorB));
+    batch(AorB, message);
+    /* a held back ACK is a reason to send a partly filled batch now */
+    if (rcv[ENTITY(AorB)].ackpending && s->batchlen > 0)
+      sendbatch(AorB);
+    else
+      flushbatch(AorB);
+  }
+  /* if the window is full, wait in the send queue for the window to slide */
+  else if (sendqueue_put(&s->sendq, message)) {
+    if (TRACE > 0)
+      printf("----%c: New message arrives, send window is full, message queued\n", NAME(AorB));
+  }
+  /* if blocked,  window and send queue are full */
+  else {
+    if (TRACE > 0)
+      printf("----%c: New message arrives, send window is full\n", NAME(AorB));
+    window_full++;
+  }
+  layer5_backpressure(AorB, s->windowcount == WINDOWSIZE && sendqueue_full(&s->sendq));
+  flushack(AorB);
+}
+
+
+/* an uncorrupted packet carrying an ACK has arrived at the sender */
+static void ackinput(int AorB, int acknum)
+{
+  struct sender *s = &snd[ENTITY(AorB)];
+  int ackcount = 0;
+  int i;
+
+  if (TRACE > 0)
+    printf("----%c: uncorrupted ACK %d is received\n", NAME(AorB), acknum);
+  total_ACKs_received++;
+
+  /* check if new ACK or duplicate */
+  if (s->windowcount != 0) {
+    int seqfirst = SLOT(s, s->windowfirst)->seqnum;
+    int seqlast = SLOT(s, s->windowlast)->seqnum;
+    /* check case when seqnum has and hasn't wrapped */
+    if (((seqfirst <= seqlast) && (acknum >= seqfirst && acknum <= seqlast)) ||
+        ((seqfirst > seqlast) && (acknum >= seqfirst || acknum <= seqlast))) {
+
+      /* packet is a new ACK */
+      if (TRACE > 0)
+        printf("----%c: ACK %d is not a duplicate\n", NAME(AorB), acknum);
+      new_ACKs++;
+
+      /* cumulative acknowledgement - determine how many packets are ACKed */
+      if (acknum >= seqfirst)
+        ackcount = acknum + 1 - seqfirst;
+      else
+        ackcount = SEQSPACE - seqfirst + acknum;
+
+      /* slide window by the number of packets ACKed */
+      s->windowfirst = (s->windowfirst + ackcount) % WINDOWSIZE;
+
+      /* delete the acked packets from window buffer */
+      for (i=0; i<ackcount; i++)
+        s->windowcount--;
+
+      /* start timer again if there are still more unacked packets in window */
+      stoptimer(AorB);
+      if (s->windowcount > 0)
+        starttimer(AorB, RTT);
+
+      /* the window has room again, send any queued messages */
+      drainqueue(AorB);
+    }
+  }
+  else
+    if (TRACE > 0)
+      printf ("----%c: duplicate ACK received, do nothing!\n", NAME(AorB));
+}
+
+/* an uncorrupted packet carrying data has arrived at the receiver */
+static void datainput(int AorB, const struct pkt *packet)
+{
+  struct receiver *r = &rcv[ENTITY(AorB)];
+  struct sender *s = &snd[ENTITY(AorB)];
+  int i;
+
+  /* if received packet is in order */
+  if  (packet->seqnum == r->expectedseqnum) {
+    if (TRACE > 0)
+      printf("----%c: packet %d is correctly received, send ACK!\n", NAME(AorB), packet->seqnum);
+    packets_received++;
+
+    /* deliver each message in the packet to the receiving application */
+    for ( i=0; i<packet->length ; i+=MSGSIZE )
+      tolayer5(AorB, packet->payload + i);
+
+    /* update state variables */
+    r->expectedseqnum = (r->expectedseqnum + 1) % SEQSPACE;        
+    r->ackowed = true;
+
+    /* piggyback the ACK on data that is ready to go, or hold it back for a
+       while if this side has data in flight that will be followed by more */
+    if (bidirectional && piggyback) {
+      if (s->batchlen > 0 && s->windowcount < WINDOWSIZE) {
+        sendbatch(AorB);
+        return;
+      }
+      if (!r->ackpending && s->windowcount > 0) {
+        r->ackpending = true;
+        r->acktime = get_sim_time();
+        return;
+      }
+    }
+  }
+  else {
+    /* packet is out of order resend last ACK */
+    if (TRACE > 0) 
+      printf("----%c: packet corrupted or not expected sequence number, resend ACK!\n", NAME(AorB));
+  }
+  sendack(AorB);
+}
+
+/* send a standalone ACK with the receiver's cumulative ACK */
+static void sendack(int AorB)
+{
+  struct pkt sendpkt;
+  int i;
+
+  rcv[ENTITY(AorB)].ackowed = false;
+  rcv[ENTITY(AorB)].ackpending = false;
+  acks_sent++;
+
+  /* create packet */
+  sendpkt.seqnum = NOTINUSE;
+  sendpkt.acknum = lastinorder(AorB);
+    
+  /* we don't have any data to send.  fill payload with 0's */
+  sendpkt.length = MSGSIZE;
+  for ( i=0; i<MSGSIZE ; i++ ) 
+    sendpkt.payload[i] = '0';  
+
+  /* computer checksum */
+  sendpkt.checksum = ComputeChecksum(&sendpkt); 
+
+  /* send out packet */
+  tolayer3 (AorB, &sendpkt);
+}
+
+/* called from layer 3, when a packet arrives for layer 4 */
+static void input(int AorB, const struct pkt *packet)
+{
+  if (IsCorrupted(packet)) {
+    /* a receiver resends its last ACK, in case the packet was data */
+    if (bidirectional || AorB == B) {
+      if (TRACE > 0) 
+        printf("----%c: packet corrupted or not expected sequence number, resend ACK!\n", NAME(AorB));
+      sendack(AorB);
+    }
+    else if (TRACE > 0)
+      printf ("----%c: corrupted ACK is received, do nothing!\n", NAME(AorB));
+    return;
+  }
+
+  if (packet->acknum != NOTINUSE)
+    ackinput(AorB, packet->acknum);
+  if (packet->seqnum != NOTINUSE)
+    datainput(AorB, packet);
+  flushack(AorB);
+}
+
+/* called when the timer goes off */
+static void timerinterrupt(int AorB)
+{
+  struct sender *s = &snd[ENTITY(AorB)];
+  struct pkt *sendpkt;
+  int i;
+
+  if (TRACE > 0)
+    printf("----%c: time out,resend packets!\n", NAME(AorB));
+
+  for(i=0; i<s->windowcount; i++) {
+    sendpkt = SLOT(s, (s->windowfirst+i) % WINDOWSIZE);
+
+    if (TRACE > 0)
+      printf ("---%c: resending packet %d\n", NAME(AorB), sendpkt->seqnum);
+
+    /* resent packets carry the current ACK */
+    stampack(AorB, sendpkt);
+    tolayer3(AorB, sendpkt);
+    packets_resent++;
+    if (i==0) starttimer(AorB,RTT);
+  }
+
+  /* a batch may have waited long enough by now */
+  flushbatch(AorB);
+  flushack(AorB);
+}       
+
+/* allocate the state of all the flows, once the mtu is known */
+static void allocflows(void)
+{
+  int n = 2 * flow_count();
+  char *arena;
+  int i;
+
+  slotsize = PKTHEADER + batchmax * MSGSIZE;
+  slotsize = (slotsize + sizeof(int) - 1) / sizeof(int) * sizeof(int);
+  snd = calloc(n, sizeof(struct sender));
+  rcv = calloc(n, sizeof(struct receiver));
+  arena = malloc((size_t)n * (WINDOWSIZE) * slotsize);
+  if (snd == NULL || rcv == NULL || arena == NULL) {
+    printf("memory allocation for flows failed.");
+    exit(EXIT_FAILURE);
+  }
+  for (i = 0; i < n; i++) {
+    snd[i].slots = arena;
+    arena += WINDOWSIZE * slotsize;
+  }
+}
+
+/* initialise one side's window, buffer, sequence numbers and receiver */
+static void init(int AorB)
+{
+  struct sender *s;
+  struct receiver *r;
+
+  if (snd == NULL)
+    allocflows();
+  s = &snd[ENTITY(AorB)];
+  r = &rcv[ENTITY(AorB)];
+
+  s->nextseqnum = 0;  /* A starts with seq num 0, do not change this */
+  s->windowfirst = 0;
+  s->windowlast = -1;   /* windowlast is where the last packet sent is stored.  
+		     new packets are placed in winlast + 1 
+		     so initially this is set to -1
+		   */
+  s->windowcount = 0;
+  s->batchlen = 0;
+
+  /* messages that arrive while the window is full are queued, not dropped */
+  sendqueue_init(&s->sendq, option_int("sendqueue", 0));
+
+  r->expectedseqnum = 0;
+  r->ackowed = false;
+  r->ackpending = false;
+}
+
+
+
+/********* A: the entity sending data to B ************/
+
+/* called from layer 5 (application layer), passed the message to be sent to other side */
+void A_output(const struct msg *message)
+{
+  output(A, message);
+}
+
+/* called from layer 3, when a packet arrives for layer 4 
+   Unless data flows in both directions this will always be an ACK.
+*/
+void A_input(const struct pkt *packet)
+{
+  input(A, packet);
+}
+
+/* called when A's timer goes off */
+void A_timerinterrupt(void)
+{
+  timerinterrupt(A);
+}       
+
+/* the following routine will be called once (only) before any other */
+/* entity A routines are called. You can use it to do any initialization */
+void A_init(void)
+{
+  /* choose the checksum used by both A and B */
+  checksum_select(option_string("checksum", "crc32c"));
+  checksum_isa(option_string("checksum_isa", "auto"));
+
+  /* data from B to A turns on piggybacked ACKs */
+  bidirectional = option_double("bmix", 0.0) > 0.0;
+  piggyback = option_int("piggyback", 1) != 0;
+  ackdelay = option_double("ackdelay", RTT / 4);
+
+  /* pack as many messages into a packet as the mtu allows */
+  batchmax = (option_int("mtu", PKTHEADER + MSGSIZE) - PKTHEADER) / MSGSIZE;
+  if (batchmax < 1)
+    batchmax = 1;
+  if (batchmax > MAXPAYLOAD / MSGSIZE)
+    batchmax = MAXPAYLOAD / MSGSIZE;
+  batchdelay = option_double("batchdelay", RTT / 2);
+
+  init(A);
+}
+
+
+
+/********* B: the entity receiving data from A ************/
+
+/* called from layer 3, when a packet arrives for layer 4 at B*/
+void B_input(const struct pkt *packet)
+{
+  input(B, packet);
+}
+
+/* the following routine will be called once (only) before any other */
+/* entity B routines are called. You can use it to do any initialization */
+void B_init(void)
+{
+  init(B);
+}
+
+/******************************************************************************
+ * The following functions are used only for bi-directional messages          *
+ *****************************************************************************/
+
+/* called from layer 5 at B when data also flows from B to A */
+void B_output(const struct msg *message)  
+{
+  output(B, message);
+}
+
+/* called when B's timer goes off */
+void B_timerinterrupt(void)
+{
+  timerinterrupt(B);
+}
+
+/******************************************************************************
+ * Snapshots of the protocol state, see checkpoint.h                          *
+ *****************************************************************************/
+
+void protocol_save_state(FILE *fp)
+{
+  int n = 2 * flow_count();
+  int i;
+
+  checkpoint_write(fp, "gbn", sizeof("gbn"));
+  checkpoint_write(fp, &slotsize, sizeof(int));
+  /* the window buffers of all flows are one block, starting at the first */
+  checkpoint_write(fp, snd[0].slots, (size_t)n * WINDOWSIZE * slotsize);
+  checkpoint_write(fp, rcv, n * sizeof(struct receiver));
+  for (i = 0; i < n; i++) {
+    checkpoint_write(fp, &snd[i], sizeof(struct sender));
+    sendqueue_save(fp, &snd[i].sendq);
+  }
+}
+
+void protocol_restore_state(FILE *fp)
+{
+  char tag[sizeof("gbn")];
+  struct sender s;
+  int n = 2 * flow_count();
+  int i, size;
+
+  checkpoint_read(fp, tag, sizeof(tag));
+  if (memcmp(tag, "gbn", sizeof(tag)) != 0)
+    checkpoint_mismatch("it is not of a GBN simulation");
+  checkpoint_read(fp, &size, sizeof(int));
+  if (size != slotsize)
+    checkpoint_mismatch("the mtu or bmix option differs");
+  checkpoint_read(fp, snd[0].slots, (size_t)n * WINDOWSIZE * slotsize);
+  checkpoint_read(fp, rcv, n * sizeof(struct receiver));
+  for (i = 0; i < n; i++) {
+    /* keep this run's buffers in place of the ones in the snapshot */
+    checkpoint_read(fp, &s, sizeof(struct sender));
+    s.slots = snd[i].slots;
+    s.sendq = snd[i].sendq;
+    snd[i] = s;
+    sendqueue_restore(fp, &snd[i].sendq);
+  }
+}
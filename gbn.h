@@ -1,11 +1,15 @@
-extern void A_init(void);
-extern void B_init(void);
-extern void A_input(struct pkt);
-extern void B_input(struct pkt);
-extern void A_output(struct msg);
-extern void A_timerinterrupt(void);
-
-/* included for extension to bidirectional communication */
-#define BIDIRECTIONAL 0       /*  0 = A->B  1 =  A<->B */
-extern void B_output(struct msg);
-extern void B_timerinterrupt(void);
\ No newline at end of file
+extern void A_init(void);
+extern void B_init(void);
+extern void A_input(const struct pkt *);
+extern void B_input(const struct pkt *);
+extern void A_output(const struct msg *);
+extern void A_timerinterrupt(void);
+
+/* used for bidirectional communication, when the bmix option is above 0 */
+extern void B_output(const struct msg *);
+extern void B_timerinterrupt(void);
+
+/* save the state of every flow's A and B to a snapshot, or restore it
+   from one, see checkpoint.h */
+extern void protocol_save_state(FILE *fp);
+extern void protocol_restore_state(FILE *fp);
\ No newline at end of file
@@ -0,0 +1,285 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "emulator.h"
+#include "options.h"
+#include "link.h"
+#include "checkpoint.h"
+
+/* ******************************************************************
+   Bottleneck link model used by tolayer3().  The queue is FIFO and the
+   link sends one packet at a time, so the time a packet starts and
+   finishes being sent is known as soon as it is queued.  Only the
+   finish times of the queued packets are kept, to tell how many are
+   still ahead of a new arrival.
+
+   RED (Floyd and Jacobson) drops arrivals with a probability that rises
+   with the average queue length.  CoDel (RFC 8289) drops at the head of
+   the queue once packets have waited longer than codel_target for a whole
+   codel_interval; as the head of the queue is reached at the time the
+   packet starts being sent, the decision is taken then.
+**********************************************************************/
+
+extern double jimsrand(void);   /* the emulator's random number generator */
+
+static struct link links[2];    /* links[A] carries packets from A to B */
+static bool enabled;            /* linkrate is above 0 */
+static double red_min, red_max; /* RED thresholds on the average queue length */
+static double red_maxp;         /* RED drop probability at red_max */
+static double red_weight;       /* RED weight of a new sample in the average */
+static double codel_target;     /* CoDel acceptable queueing delay */
+static double codel_interval;   /* CoDel window for the minimum queueing delay */
+
+enum link_aqm link_aqm(const char *name)
+{
+  if (strcmp(name, "red") == 0)
+    return AQM_RED;
+  if (strcmp(name, "codel") == 0)
+    return AQM_CODEL;
+  if (strcmp(name, "droptail") != 0)
+    printf("Warning: unknown aqm %s, using droptail\n", name);
+  return AQM_DROPTAIL;
+}
+
+void link_setup(struct link *l, double rate, double propdelay, int capacity, enum link_aqm aqm)
+{
+  free(l->finish);
+  memset(l, 0, sizeof(struct link));
+  l->rate = rate;
+  l->propdelay = propdelay;
+  l->aqm = aqm;
+  l->capacity = capacity > 0 ? capacity : 1;
+  l->finish = malloc(l->capacity * sizeof(double));
+  if (l->finish == NULL) {
+    printf("memory allocation for link queue failed.");
+    exit(EXIT_FAILURE);
+  }
+}
+
+void link_init(void)
+{
+  double rate = option_double("linkrate", 0.0);
+  enum link_aqm aqm = link_aqm(option_string("aqm", "droptail"));
+  int i;
+
+  red_min = option_double("red_min", 5.0);
+  red_max = option_double("red_max", 15.0);
+  red_maxp = option_double("red_maxp", 0.1);
+  red_weight = option_double("red_weight", 0.002);
+  codel_target = option_double("codel_target", 1.0);
+  codel_interval = option_double("codel_interval", 20.0);
+
+  enabled = rate > 0.0;
+  if (enabled)
+    for (i = 0; i < 2; i++)
+      link_setup(&links[i], rate, option_double("linkdelay", 1.0), option_int("linkqueue", 50), aqm);
+}
+
+bool link_enabled(void)
+{
+  return enabled;
+}
+
+double link_lookahead(void)
+{
+  return links[A].propdelay < links[B].propdelay ? links[A].propdelay : links[B].propdelay;
+}
+
+/* RED: drop an arrival early, given the current queue length */
+static bool red_drop(struct link *l, int depth)
+{
+  double pb, pa;
+
+  l->avg += red_weight * (depth - l->avg);
+  if (l->avg < red_min) {
+    l->sincedrop = 0;
+    return false;
+  }
+  if (l->avg >= red_max) {
+    l->sincedrop = 0;
+    return true;
+  }
+
+  /* spread the drops out evenly rather than in clusters */
+  pb = red_maxp * (l->avg - red_min) / (red_max - red_min);
+  pa = l->sincedrop * pb < 1.0 ? pb / (1.0 - l->sincedrop * pb) : 1.0;
+  if (jimsrand() < pa) {
+    l->sincedrop = 0;
+    return true;
+  }
+  l->sincedrop++;
+  return false;
+}
+
+/* one Newton step towards 1/sqrt(dropcount), as in the Linux CoDel */
+static void codel_newton(struct link *l)
+{
+  double x = l->invsqrt;
+
+  l->invsqrt = x * (3.0 - l->dropcount * x * x) / 2.0;
+}
+
+/* CoDel: drop the packet at the head of the queue at time now, after it waited sojourn */
+static bool codel_drop(struct link *l, double now, double sojourn)
+{
+  bool oktodrop;
+
+  /* is the queueing delay above target, and has it been for an interval? */
+  if (sojourn < codel_target) {
+    l->firstabove = 0.0;
+    oktodrop = false;
+  }
+  else if (l->firstabove == 0.0) {
+    l->firstabove = now + codel_interval;
+    oktodrop = false;
+  }
+  else
+    oktodrop = now >= l->firstabove;
+
+  if (l->dropping) {
+    if (!oktodrop) {
+      l->dropping = false;
+      return false;
+    }
+    if (now < l->dropnext)
+      return false;
+    /* drop faster the longer the delay stays high */
+    l->dropcount++;
+    codel_newton(l);
+    l->dropnext += codel_interval * l->invsqrt;
+    return true;
+  }
+  if (!oktodrop)
+    return false;
+
+  /* enter the dropping state, resuming the drop rate if it was left recently */
+  l->dropping = true;
+  if (l->dropcount - l->lastcount > 1 && now - l->dropnext < 16 * codel_interval) {
+    l->dropcount -= l->lastcount;
+    codel_newton(l);
+  }
+  else {
+    l->dropcount = 1;
+    l->invsqrt = 1.0;
+  }
+  l->lastcount = l->dropcount;
+  l->dropnext = now + codel_interval * l->invsqrt;
+  return true;
+}
+
+bool link_enqueue(struct link *l, double now, int bytes, double *arrival)
+{
+  double start, finish;
+  bool dropped = false;
+  int last;
+
+  l->packets++;
+
+  /* packets that have been sent by now leave the queue */
+  while (l->count > 0 && l->finish[l->first] <= now) {
+    l->first = (l->first + 1) % l->capacity;
+    l->count--;
+  }
+
+  if (l->count >= l->capacity) {
+    l->taildrops++;
+    if (TRACE > 0)
+      printf("          TOLAYER3: packet dropped, link queue is full\n");
+    return false;
+  }
+  if (l->aqm == AQM_RED && red_drop(l, l->count)) {
+    l->aqmdrops++;
+    if (TRACE > 0)
+      printf("          TOLAYER3: packet dropped early by RED\n");
+    return false;
+  }
+
+  start = l->busyuntil > now ? l->busyuntil : now;
+  finish = start + bytes / l->rate;
+
+  /* a packet CoDel drops leaves the queue when it reaches the head */
+  if (l->aqm == AQM_CODEL && codel_drop(l, start, start - now)) {
+    l->aqmdrops++;
+    dropped = true;
+    finish = start;
+    if (TRACE > 0)
+      printf("          TOLAYER3: packet dropped by CoDel after %f in the queue\n", start - now);
+  }
+
+  last = (l->first + l->count) % l->capacity;
+  l->finish[last] = finish;
+  l->count++;
+  if (l->count > l->maxdepth)
+    l->maxdepth = l->count;
+  if (dropped)
+    return false;
+
+  l->busyuntil = finish;
+  l->busytime += finish - start;
+  l->sojourn += finish - now;
+  l->qdelay += start - now;
+  if (start - now > l->maxqdelay)
+    l->maxqdelay = start - now;
+  *arrival = finish + l->propdelay;
+  return true;
+}
+
+bool link_send(int AorB, double now, int bytes, double *arrival)
+{
+  return link_enqueue(&links[AorB], now, bytes, arrival);
+}
+
+void link_print(const char *name, const struct link *l, double end)
+{
+  int sent = l->packets - l->taildrops - l->aqmdrops;
+
+  printf("link %s: packets offered %d, dropped when full %d, dropped early %d \n",
+         name, l->packets, l->taildrops, l->aqmdrops);
+  printf("link %s: average queue length %f, maximum %d, utilisation %f \n",
+         name, end > 0.0 ? l->sojourn / end : 0.0, l->maxdepth,
+         end > 0.0 ? l->busytime / end : 0.0);
+  printf("link %s: average queueing delay %f, maximum %f \n",
+         name, sent > 0 ? l->qdelay / sent : 0.0, l->maxqdelay);
+}
+
+void link_report(double end)
+{
+  if (!link_enabled())
+    return;
+  link_print("A->B", &links[A], end);
+  link_print("B->A", &links[B], end);
+}
+
+void link_save(FILE *fp, const struct link *l)
+{
+  checkpoint_write(fp, l, sizeof(struct link));
+  checkpoint_write(fp, l->finish, l->capacity * sizeof(double));
+}
+
+void link_restore(FILE *fp, struct link *l)
+{
+  struct link saved;
+
+  checkpoint_read(fp, &saved, sizeof(struct link));
+  if (saved.capacity != l->capacity)
+    checkpoint_mismatch("a link queue size differs");
+  saved.rate = l->rate;
+  saved.propdelay = l->propdelay;
+  saved.aqm = l->aqm;
+  saved.finish = l->finish;
+  *l = saved;
+  checkpoint_read(fp, l->finish, l->capacity * sizeof(double));
+}
+
+void link_save_state(FILE *fp)
+{
+  link_save(fp, &links[A]);
+  link_save(fp, &links[B]);
+}
+
+void link_restore_state(FILE *fp)
+{
+  link_restore(fp, &links[A]);
+  link_restore(fp, &links[B]);
+}
@@ -0,0 +1,79 @@
+/* the bottleneck link between A and B, one per direction.  A packet is
+   serialized at linkrate bytes per time unit after the packets queued
+   ahead of it, then takes linkdelay time units to reach the other side.
+   The queue holds at most linkqueue packets and drops arrivals at the
+   tail when full; the aqm option adds early drops with RED or CoDel.
+   With linkrate=0 (the default) the link is off and the emulator keeps
+   its original 1 to 10 time unit delay.  The links of a multi-hop
+   topology (see topology.h) are the same model with their own settings. */
+
+enum link_aqm { AQM_DROPTAIL, AQM_RED, AQM_CODEL };
+
+struct link {
+  double rate;            /* bytes per time unit */
+  double propdelay;       /* propagation delay in time units */
+  enum link_aqm aqm;      /* early drop policy */
+  double *finish;         /* circular buffer of the finish times of queued packets */
+  int capacity;           /* the maximum number of queued packets */
+  int first;              /* index of the oldest queued packet */
+  int count;              /* the number of packets queued or being sent */
+  double busyuntil;       /* time the last queued packet has been sent */
+
+  /* RED state */
+  double avg;             /* moving average of the queue length */
+  int sincedrop;          /* packets accepted since the last early drop */
+
+  /* CoDel state */
+  double firstabove;      /* time the sojourn time will have been above target for an interval */
+  double dropnext;        /* time of the next drop while dropping */
+  bool dropping;          /* in the dropping state */
+  int dropcount;          /* drops since entering the dropping state */
+  int lastcount;          /* dropcount when the dropping state was last left */
+  double invsqrt;         /* 1/sqrt(dropcount), for the CoDel control law */
+
+  /* statistics */
+  int packets;            /* packets offered to the link */
+  int taildrops;          /* packets dropped because the queue was full */
+  int aqmdrops;           /* packets dropped early by RED or CoDel */
+  int maxdepth;           /* the largest number of packets queued at one time */
+  double sojourn;         /* total time packets spent queued and being sent */
+  double qdelay;          /* total time packets waited before being sent */
+  double maxqdelay;       /* the longest a packet waited before being sent */
+  double busytime;        /* total time the link spent sending */
+};
+
+extern void link_init(void);
+extern bool link_enabled(void);
+
+/* the least time a packet can take to cross the link, its propagation delay */
+extern double link_lookahead(void);
+
+/* the aqm called name, or AQM_DROPTAIL with a warning if there is none */
+extern enum link_aqm link_aqm(const char *name);
+
+/* set up a link with its own rate, delay, queue capacity and aqm */
+extern void link_setup(struct link *l, double rate, double propdelay, int capacity, enum link_aqm aqm);
+
+/* offer a packet of bytes bytes to link l at time now, returns false if it
+   is dropped and otherwise sets *arrival to its arrival time at the far end */
+extern bool link_enqueue(struct link *l, double now, int bytes, double *arrival);
+
+/* save the queue and statistics of link l to a snapshot, or restore them
+   from one, see checkpoint.h.  The rate, delay and aqm stay as set up. */
+extern void link_save(FILE *fp, const struct link *l);
+extern void link_restore(FILE *fp, struct link *l);
+
+/* print the statistics of link l, called name, the simulation ended at time end */
+extern void link_print(const char *name, const struct link *l, double end);
+
+/* offer a packet of bytes bytes sent by A or B at time now, returns false
+   if it is dropped and otherwise sets *arrival to its arrival time at the
+   other side */
+extern bool link_send(int AorB, double now, int bytes, double *arrival);
+
+/* save or restore both directions */
+extern void link_save_state(FILE *fp);
+extern void link_restore_state(FILE *fp);
+
+/* print the per-direction statistics, the simulation ended at time end */
+extern void link_report(double end);
@@ -0,0 +1,250 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "emulator.h"
+#include "options.h"
+#include "loss.h"
+#include "checkpoint.h"
+
+/* ******************************************************************
+   Packet loss models used by tolayer3(), one per direction.  All the
+   random numbers come from the emulator's jimsrand(), and the bernoulli
+   model draws exactly one per packet as the original emulator did, so
+   runs with the default model are unchanged.
+
+   Loss traces are mapped into memory rather than read, so a trace of
+   millions of packets costs nothing until it is replayed.
+**********************************************************************/
+
+extern double jimsrand(void);   /* the emulator's random number generator */
+
+static struct lossmodel models[2];  /* models[A] loses packets sent by A */
+static int direction;           /* corruptdirection read from standard input */
+
+/* map a loss trace file into memory */
+static void loadtrace(struct lossmodel *m, const char *path)
+{
+  struct stat st;
+  void *p;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0) {
+    printf("Warning: can not read loss trace %s, using no loss\n", path);
+    if (fd >= 0)
+      close(fd);
+    m->model = LOSS_NONE;
+    return;
+  }
+  p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    printf("Warning: can not map loss trace %s, using no loss\n", path);
+    m->model = LOSS_NONE;
+    return;
+  }
+  m->trace = p;
+  m->tracelen = st.st_size;
+  m->tracepos = 0;
+}
+
+/* forget model m's trace and statistics */
+static void resetmodel(struct lossmodel *m)
+{
+  if (m->trace != NULL)
+    munmap((void *)m->trace, m->tracelen);
+  memset(m, 0, sizeof(struct lossmodel));
+}
+
+/* set up the model for packets sent by A or B from the loss and losstrace options */
+static void initmodel(int AorB, float lossprob, const char *modelopt, const char *traceopt)
+{
+  struct lossmodel *m = &models[AorB];
+  const char *name;
+
+  resetmodel(m);
+  m->prob = lossprob;
+  m->ge_p = option_double("ge_p", 0.01);
+  m->ge_r = option_double("ge_r", 0.3);
+  m->lossgood = option_double("ge_lossgood", 0.0);
+  m->lossbad = option_double("ge_lossbad", 1.0);
+
+  name = option_string(modelopt, option_string("loss", "bernoulli"));
+  if (strcmp(name, "gilbert") == 0)
+    m->model = LOSS_GILBERT;
+  else if (strcmp(name, "trace") == 0) {
+    m->model = LOSS_TRACE;
+    loadtrace(m, option_string(traceopt, option_string("losstrace", "loss.txt")));
+  }
+  else if (strcmp(name, "none") == 0)
+    m->model = LOSS_NONE;
+  else {
+    if (strcmp(name, "bernoulli") != 0)
+      printf("Warning: unknown loss model %s, using bernoulli\n", name);
+    m->model = LOSS_BERNOULLI;
+  }
+}
+
+void loss_init(float lossprob, int lossdirection)
+{
+  direction = lossdirection;
+  initmodel(A, lossprob, "loss_ab", "losstrace_ab");
+  initmodel(B, lossprob, "loss_ba", "losstrace_ba");
+}
+
+bool lossmodel_init(struct lossmodel *m, const char *spec)
+{
+  char *end;
+
+  resetmodel(m);
+  m->lossbad = 1.0;
+  if (strcmp(spec, "none") == 0) {
+    m->model = LOSS_NONE;
+    return true;
+  }
+  if (strncmp(spec, "trace:", 6) == 0) {
+    m->model = LOSS_TRACE;
+    loadtrace(m, spec + 6);
+    return true;
+  }
+  if (strncmp(spec, "gilbert:", 8) == 0) {
+    m->model = LOSS_GILBERT;
+    return sscanf(spec + 8, "%lf:%lf:%lf:%lf", &m->ge_p, &m->ge_r, &m->lossgood, &m->lossbad) >= 2;
+  }
+  m->model = LOSS_BERNOULLI;
+  m->prob = strtod(spec, &end);
+  return end != spec && *end == '\0';
+}
+
+/* the next packet from the loss trace, skipping anything but '0' and '1' */
+static bool tracelost(struct lossmodel *m)
+{
+  size_t i;
+  char c;
+
+  for (i = 0; i < m->tracelen; i++) {
+    c = m->trace[m->tracepos];
+    m->tracepos = (m->tracepos + 1) % m->tracelen;
+    if (c == '0' || c == '1')
+      return c == '1';
+  }
+  return false;   /* the trace holds no packets at all */
+}
+
+/* count the packet in model m's statistics */
+static bool account(struct lossmodel *m, bool lost)
+{
+  m->packets++;
+  if (lost) {
+    m->lost++;
+    if (!m->lastlost)
+      m->bursts++;
+  }
+  m->lastlost = lost;
+  return lost;
+}
+
+bool lossmodel_drop(struct lossmodel *m)
+{
+  bool lost = false;
+
+  switch (m->model) {
+  case LOSS_BERNOULLI:
+    lost = jimsrand() < m->prob;
+    break;
+  case LOSS_GILBERT:
+    if (m->bad) {
+      if (jimsrand() < m->ge_r)
+        m->bad = false;
+    }
+    else if (jimsrand() < m->ge_p)
+      m->bad = true;
+    lost = jimsrand() < (m->bad ? m->lossbad : m->lossgood);
+    break;
+  case LOSS_TRACE:
+    lost = tracelost(m);
+    break;
+  case LOSS_NONE:
+    break;
+  }
+  return account(m, lost);
+}
+
+bool loss_drop(int AorB)
+{
+  struct lossmodel *m = &models[AorB];
+
+  /* the original loss only happens in the directions corruptdirection allows */
+  if (m->model == LOSS_BERNOULLI)
+    return account(m, jimsrand() < m->prob &&
+                   (!(AorB == B && direction == A) && !(AorB == A && direction == B)));
+  return lossmodel_drop(m);
+}
+
+void loss_count(int AorB, bool lost)
+{
+  account(&models[AorB], lost);
+}
+
+void lossmodel_print(const char *name, const struct lossmodel *m)
+{
+  static const char *names[] = { "none", "bernoulli", "gilbert", "trace" };
+
+  printf("loss %s (%s): packets lost %d of %d, average loss burst %f \n",
+         name, names[m->model], m->lost, m->packets,
+         m->bursts > 0 ? (double)m->lost / m->bursts : 0.0);
+}
+
+void loss_report(void)
+{
+  if (models[A].model == LOSS_BERNOULLI && models[B].model == LOSS_BERNOULLI)
+    return;
+  lossmodel_print("A->B", &models[A]);
+  lossmodel_print("B->A", &models[B]);
+}
+
+void lossmodel_save(FILE *fp, const struct lossmodel *m)
+{
+  checkpoint_write(fp, m, sizeof(struct lossmodel));
+}
+
+void lossmodel_restore(FILE *fp, struct lossmodel *m)
+{
+  struct lossmodel saved;
+
+  checkpoint_read(fp, &saved, sizeof(struct lossmodel));
+  m->bad = saved.bad;
+  if (m->tracelen > 0)
+    m->tracepos = saved.tracepos % m->tracelen;
+  m->packets = saved.packets;
+  m->lost = saved.lost;
+  m->bursts = saved.bursts;
+  m->lastlost = saved.lastlost;
+}
+
+void loss_save_state(FILE *fp)
+{
+  lossmodel_save(fp, &models[A]);
+  lossmodel_save(fp, &models[B]);
+}
+
+void loss_restore_state(FILE *fp)
+{
+  lossmodel_restore(fp, &models[A]);
+  lossmodel_restore(fp, &models[B]);
+}
+
+void loss_setprob(float lossprob)
+{
+  int i;
+
+  for (i = 0; i < 2; i++)
+    if (models[i].model == LOSS_BERNOULLI)
+      models[i].prob = lossprob;
+}
@@ -0,0 +1,72 @@
+/* packet loss models, chosen for each direction with the loss option
+   (both directions) or loss_ab and loss_ba (A to B, B to A):
+     "bernoulli"  each packet is lost independently with the loss
+                  probability given on standard input, in the directions
+                  chosen by corruptdirection (the original behaviour)
+     "gilbert"    two state Gilbert-Elliott burst loss: the channel moves
+                  from the good to the bad state with probability ge_p and
+                  back with probability ge_r before each packet, and loses
+                  the packet with probability ge_lossgood or ge_lossbad
+     "trace"      replays a recorded loss pattern from the file given by
+                  losstrace (or losstrace_ab, losstrace_ba): one character
+                  per packet, '1' lost and '0' delivered, other characters
+                  are skipped and the pattern repeats when it runs out
+     "none"       no loss
+   The links of a multi-hop topology each have a model of their own,
+   given as a spec, see lossmodel_init(). */
+
+enum loss_model { LOSS_NONE, LOSS_BERNOULLI, LOSS_GILBERT, LOSS_TRACE };
+
+struct lossmodel {
+  enum loss_model model;
+  double prob;            /* bernoulli loss probability */
+  double ge_p, ge_r;      /* Gilbert-Elliott good to bad and bad to good probabilities */
+  double lossgood;        /* Gilbert-Elliott loss probability in the good state */
+  double lossbad;         /* Gilbert-Elliott loss probability in the bad state */
+  bool bad;               /* Gilbert-Elliott channel is in the bad state */
+  const char *trace;      /* mmap'd loss trace */
+  size_t tracelen;        /* length of the trace in bytes */
+  size_t tracepos;        /* position of the next packet in the trace */
+
+  /* statistics */
+  int packets;            /* packets sent in this direction */
+  int lost;               /* packets lost */
+  int bursts;             /* runs of consecutive losses */
+  bool lastlost;          /* the previous packet was lost */
+};
+
+/* lossprob and lossdirection are the values read from standard input */
+extern void loss_init(float lossprob, int lossdirection);
+
+/* decide whether the packet being sent by A or B is lost */
+extern bool loss_drop(int AorB);
+
+/* count a loss decision for A or B made elsewhere, a replayed one */
+extern void loss_count(int AorB, bool lost);
+
+/* print the per-direction statistics, unless both directions are bernoulli */
+extern void loss_report(void);
+
+/* set up model m from a spec: "none", a bernoulli probability such as
+   "0.01", "gilbert:p:r" or "gilbert:p:r:lossgood:lossbad", or "trace:file".
+   Returns false if the spec is not understood. */
+extern bool lossmodel_init(struct lossmodel *m, const char *spec);
+
+/* decide whether the next packet through model m is lost */
+extern bool lossmodel_drop(struct lossmodel *m);
+
+/* save the state and statistics of model m to a snapshot, or restore
+   them from one, see checkpoint.h.  The model and its parameters stay as
+   set up, so a restored simulation can continue with other ones. */
+extern void lossmodel_save(FILE *fp, const struct lossmodel *m);
+extern void lossmodel_restore(FILE *fp, struct lossmodel *m);
+
+/* save or restore both directions */
+extern void loss_save_state(FILE *fp);
+extern void loss_restore_state(FILE *fp);
+
+/* change the bernoulli loss probability of both directions */
+extern void loss_setprob(float lossprob);
+
+/* print the statistics of model m, called name */
+extern void lossmodel_print(const char *name, const struct lossmodel *m);
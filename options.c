@@ -0,0 +1,92 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "options.h"
+
+/* ******************************************************************
+   Command line options.  Every option is a name=value pair, so the
+   emulator, the protocols and any other module can look up the knobs
+   they care about without a central option table.  The interactive
+   questions asked by the emulator are not affected.
+**********************************************************************/
+
+static int noptions = 0;
+static char **options = NULL;
+
+void options_init(int argc, char *argv[])
+{
+  int i;
+
+  noptions = 0;
+  options = argv;
+  for (i=1; i<argc; i++) {
+    if (strchr(argv[i], '=') == NULL) {
+      printf("Warning: ignoring option %s, expected name=value\n", argv[i]);
+      continue;
+    }
+    options[noptions++] = argv[i];
+  }
+}
+
+/* return the value given for name, or NULL if the option was not given */
+static const char *option_lookup(const char *name)
+{
+  const char *p, *eq;
+  int i;
+  size_t len = strlen(name);
+
+  /* the last occurrence wins, so options can be overridden */
+  for (i=noptions-1; i>=0; i--) {
+    p = options[i];
+    while (*p == '-')
+      p++;
+    eq = strchr(p, '=');
+    if ((size_t)(eq - p) == len && strncmp(p, name, len) == 0)
+      return eq + 1;
+  }
+  return NULL;
+}
+
+int option_int(const char *name, int defval)
+{
+  const char *value = option_lookup(name);
+  char *end;
+  long x;
+
+  if (value == NULL)
+    return defval;
+  x = strtol(value, &end, 0);
+  if (end == value || *end != '\0') {
+    printf("Warning: option %s expects an integer, using %d\n", name, defval);
+    return defval;
+  }
+  return (int)x;
+}
+
+double option_double(const char *name, double defval)
+{
+  const char *value = option_lookup(name);
+  char *end;
+  double x;
+
+  if (value == NULL)
+    return defval;
+  x = strtod(value, &end);
+  if (end == value || *end != '\0') {
+    printf("Warning: option %s expects a number, using %f\n", name, defval);
+    return defval;
+  }
+  return x;
+}
+
+const char *option_string(const char *name, const char *defval)
+{
+  const char *value = option_lookup(name);
+
+  return value == NULL ? defval : value;
+}
+
+const char *option_given(int i)
+{
+  return i >= 0 && i < noptions ? options[i] : NULL;
+}
@@ -0,0 +1,12 @@
+/* run time options given on the command line as name=value pairs, e.g.
+     ./gbn sendqueue=64 backpressure=1
+   a leading "-" or "--" on the name is ignored.  Options that are not given
+   take the default value supplied by the caller. */
+
+extern void options_init(int argc, char *argv[]);
+extern int option_int(const char *name, int defval);
+extern double option_double(const char *name, double defval);
+extern const char *option_string(const char *name, const char *defval);
+
+/* the i-th name=value option given, counting from 0, or NULL past the last */
+extern const char *option_given(int i);
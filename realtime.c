@@ -0,0 +1,125 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "options.h"
+#include "realtime.h"
+
+/* ******************************************************************
+   Real-time pacing for the emulator.  Times are kept as nanoseconds on
+   the monotonic clock.  Simulated time t is due at base + t * scale;
+   an event that is not due yet is slept for with one absolute sleep, so
+   errors do not add up from one event to the next, and one that is
+   already due runs at once and counts as late.  Events at the same
+   simulated time share one wait.
+**********************************************************************/
+
+static double scale;              /* nanoseconds per time unit, 0 = off */
+static bool usetimerfd;
+static int tfd = -1;
+static double base;               /* nanoseconds at simulated time 0 */
+static double lastwait = -1.0;    /* simulated time of the last wait */
+
+/* statistics */
+static long waits;                /* times an event's wall-clock time was waited for */
+static long sleeps;               /* waits that had to sleep */
+static long late;                 /* waits that found the event already due */
+static double lagsum, lagmax;     /* nanoseconds from due to running */
+
+static double nanonow(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void realtime_init(double start)
+{
+  const char *how;
+
+  scale = option_double("realtime", 0.0);
+  if (scale <= 0.0)
+    return;
+  how = option_string("realtime_clock", "nanosleep");
+  if (strcmp(how, "timerfd") == 0) {
+    usetimerfd = true;
+    tfd = timerfd_create(CLOCK_MONOTONIC, 0);
+    if (tfd < 0) {
+      perror("timerfd_create");
+      exit(EXIT_FAILURE);
+    }
+  }
+  else if (strcmp(how, "nanosleep") != 0) {
+    printf("realtime_clock must be nanosleep or timerfd, not %s\n", how);
+    exit(EXIT_FAILURE);
+  }
+  base = nanonow() - start * scale;
+}
+
+bool realtime_enabled(void)
+{
+  return scale > 0.0;
+}
+
+/* sleep until the monotonic clock reads due nanoseconds */
+static void sleepuntil(double due)
+{
+  struct itimerspec its;
+  struct timespec ts;
+  uint64_t expirations;
+
+  ts.tv_sec = (time_t)(due / 1e9);
+  ts.tv_nsec = (long)(due - ts.tv_sec * 1e9);
+  if (!usetimerfd) {
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0)
+      ;
+    return;
+  }
+  memset(&its, 0, sizeof(its));
+  its.it_value = ts;
+  if (ts.tv_sec == 0 && ts.tv_nsec == 0)
+    return;                       /* a zero time would disarm the timer */
+  timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL);
+  while (read(tfd, &expirations, sizeof(expirations)) < 0)
+    ;
+}
+
+void realtime_wait(double t)
+{
+  double due, now, lag;
+
+  if (t == lastwait)
+    return;
+  lastwait = t;
+  due = base + t * scale;
+  now = nanonow();
+  if (now < due) {
+    sleepuntil(due);
+    now = nanonow();
+    sleeps++;
+  }
+  else
+    late++;
+  waits++;
+  lag = now - due;
+  lagsum += lag;
+  if (lag > lagmax)
+    lagmax = lag;
+}
+
+void realtime_report(void)
+{
+  if (scale <= 0.0)
+    return;
+  printf("real-time pacing (nanoseconds per time unit):  %f \n", scale);
+  printf("number of event times waited for:  %ld, slept for:  %ld, already late:  %ld \n",
+         waits, sleeps, late);
+  printf("scheduling lag (microseconds):  average %f, maximum %f \n",
+         waits > 0 ? lagsum / waits / 1e3 : 0.0, lagmax / 1e3);
+}
@@ -0,0 +1,21 @@
+/* real-time pacing, turned on with the realtime option: the number of
+   nanoseconds of wall-clock time one simulated time unit takes.  The
+   emulator then sleeps before each event until the wall-clock time that
+   corresponds to it, on the monotonic clock, so that it can run
+   alongside real programs.  realtime_clock chooses how to sleep:
+   "nanosleep" (clock_nanosleep() to an absolute time, the default) or
+   "timerfd" (a timerfd armed with an absolute time, then read).  The lag
+   of every event behind its wall-clock time is measured, to show when
+   the simulation can not keep up. */
+
+/* read the options; simulated time start happens now */
+extern void realtime_init(double start);
+
+/* whether the realtime option is above 0 */
+extern bool realtime_enabled(void);
+
+/* wait until the wall-clock time of an event at simulated time t */
+extern void realtime_wait(double t);
+
+/* print the scheduling lag, if pacing is on */
+extern void realtime_report(void);
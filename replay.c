@@ -0,0 +1,167 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "emulator.h"
+#include "options.h"
+#include "replay.h"
+
+/* ******************************************************************
+   Record and replay of arrivals and channel choices.  The log is text,
+   one choice per line in the order they were made:
+     a FLOW INTERVAL SIDE
+     p FLOW SENDER LOST DELAY CORRUPT KIND
+   Replaying reads the whole log into a queue per flow for arrivals and
+   per flow and sender for packets, so runs that interleave the flows
+   differently still pair up each flow's choices.
+**********************************************************************/
+
+struct arrivals {
+  struct arrivalchoice *c;
+  int n, max, next;
+};
+
+struct channels {
+  struct channelchoice *c;
+  int n, max, next;
+};
+
+static FILE *recfp;                 /* the log being recorded */
+static bool replaying;
+static struct arrivals *arrivals;   /* indexed by flow */
+static struct channels *channels;   /* indexed by 2 * flow + sender */
+static int arrivalsreplayed, arrivalsdrawn;
+static int packetsreplayed, packetsdrawn;
+
+static void *grow(void *p, int *max, size_t size)
+{
+  *max = *max ? 2 * *max : 64;
+  p = realloc(p, *max * size);
+  if (p == NULL) {
+    printf("memory allocation for replay log failed.");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+static void load(const char *path)
+{
+  char line[256];
+  struct arrivalchoice a;
+  struct channelchoice c;
+  int flow, sender, lineno = 0;
+  FILE *fp;
+
+  fp = fopen(path, "r");
+  if (fp == NULL) {
+    printf("can not read replay log %s\n", path);
+    exit(EXIT_FAILURE);
+  }
+  arrivals = calloc(flow_count(), sizeof(struct arrivals));
+  channels = calloc(2 * flow_count(), sizeof(struct channels));
+  if (arrivals == NULL || channels == NULL) {
+    printf("memory allocation for replay log failed.");
+    exit(EXIT_FAILURE);
+  }
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    lineno++;
+    if (sscanf(line, "a %d %lf %d", &flow, &a.interval, &a.side) == 3 &&
+        flow >= 0 && flow < flow_count()) {
+      struct arrivals *q = &arrivals[flow];
+      if (q->n == q->max)
+        q->c = grow(q->c, &q->max, sizeof(struct arrivalchoice));
+      q->c[q->n++] = a;
+    }
+    else if (sscanf(line, "p %d %d %d %lf %lf %lf", &flow, &sender, &c.lost,
+                    &c.delay, &c.corrupt, &c.kind) == 6 &&
+             flow >= 0 && flow < flow_count() && (sender == A || sender == B)) {
+      struct channels *q = &channels[2 * flow + sender];
+      if (q->n == q->max)
+        q->c = grow(q->c, &q->max, sizeof(struct channelchoice));
+      q->c[q->n++] = c;
+    }
+    else {
+      printf("replay log %s line %d: not a choice of one of the %d flows\n",
+             path, lineno, flow_count());
+      exit(EXIT_FAILURE);
+    }
+  }
+  fclose(fp);
+}
+
+void replay_init(void)
+{
+  const char *path;
+
+  path = option_string("replay", "");
+  if (path[0] != '\0') {
+    load(path);
+    replaying = true;
+  }
+  path = option_string("record", "");
+  if (path[0] != '\0') {
+    recfp = fopen(path, "w");
+    if (recfp == NULL) {
+      printf("can not write replay log %s\n", path);
+      exit(EXIT_FAILURE);
+    }
+  }
+}
+
+bool replay_arrival(int flow, struct arrivalchoice *c)
+{
+  struct arrivals *q;
+
+  if (!replaying)
+    return false;
+  q = &arrivals[flow];
+  if (q->next == q->n) {
+    arrivalsdrawn++;
+    return false;
+  }
+  *c = q->c[q->next++];
+  arrivalsreplayed++;
+  return true;
+}
+
+void replay_channel(int flow, int AorB, struct channelchoice *c)
+{
+  struct channels *q;
+
+  c->lost = -1;
+  c->delay = c->corrupt = c->kind = -1.0;
+  if (!replaying)
+    return;
+  q = &channels[2 * flow + AorB];
+  if (q->next == q->n) {
+    packetsdrawn++;
+    return;
+  }
+  *c = q->c[q->next++];
+  packetsreplayed++;
+}
+
+void record_arrival(int flow, const struct arrivalchoice *c)
+{
+  if (recfp != NULL)
+    fprintf(recfp, "a %d %.17g %d\n", flow, c->interval, c->side);
+}
+
+void record_channel(int flow, int AorB, const struct channelchoice *c)
+{
+  if (recfp != NULL)
+    fprintf(recfp, "p %d %d %d %.17g %.17g %.17g\n", flow, AorB, c->lost,
+            c->delay, c->corrupt, c->kind);
+}
+
+void replay_report(void)
+{
+  if (recfp != NULL)
+    fclose(recfp);
+  recfp = NULL;
+  if (!replaying)
+    return;
+  printf("number of message arrivals replayed:  %d, drawn afresh:  %d \n",
+         arrivalsreplayed, arrivalsdrawn);
+  printf("number of packets with replayed channel choices:  %d, drawn afresh:  %d \n",
+         packetsreplayed, packetsdrawn);
+}
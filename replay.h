@@ -0,0 +1,39 @@
+/* record and replay of the randomness that comes from outside the
+   protocols.  With record=FILE the emulator logs every flow's message
+   arrivals (the time to the next message and the side it arrives at) and
+   for every packet sent into the channel the loss decision, the delay and
+   the draws that decide corruption.  With replay=FILE a later run takes
+   the same choices from the log: the n-th message of a flow and the n-th
+   packet a side of a flow sends see what they saw in the recorded run,
+   whatever the protocol does in between, so two protocols or two
+   versions of one meet the same network.  Choices the log has no entry
+   for are drawn afresh.  The losses of topology links and RED's early
+   drops are always drawn afresh. */
+
+struct arrivalchoice {
+  double interval;        /* time to the flow's next message */
+  int side;               /* A or B, the side it arrives at */
+};
+
+struct channelchoice {    /* each is -1 when the choice was not made */
+  int lost;               /* 1 if the packet was lost, 0 if not */
+  double delay;           /* the channel delay */
+  double corrupt;         /* the draw deciding whether it is corrupted */
+  double kind;            /* the draw deciding what is corrupted */
+};
+
+extern void replay_init(void);
+
+/* the next arrival choice of flow from the replay log, false if there is none */
+extern bool replay_arrival(int flow, struct arrivalchoice *c);
+
+/* the choices for the next packet A or B of flow sends, from the replay
+   log, all -1 if there are none */
+extern void replay_channel(int flow, int AorB, struct channelchoice *c);
+
+/* log the choices made, when recording */
+extern void record_arrival(int flow, const struct arrivalchoice *c);
+extern void record_channel(int flow, int AorB, const struct channelchoice *c);
+
+/* print how many choices were replayed */
+extern void replay_report(void);
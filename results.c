@@ -0,0 +1,172 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <float.h>
+#include "options.h"
+#include "results.h"
+
+/* ******************************************************************
+   Result records for scripts.  The fields are kept as formatted text
+   until the end of the run, when they are written as JSON or CSV in
+   one go, so a record is never left half written by a run that stops
+   early.
+**********************************************************************/
+
+enum results_format { RESULTS_NONE, RESULTS_JSON, RESULTS_CSV };
+
+struct field {
+  char name[48];
+  char value[512];                /* formatted, strings as they are */
+  bool isstring;                  /* value is quoted when written */
+};
+
+static enum results_format format;
+static const char *path;          /* the file records are added to, NULL for stdout */
+static struct field *fields;
+static int nfields, maxfields;
+static struct timespec began;
+
+void results_init(void)
+{
+  const char *name = option_string("results", "none");
+
+  if (strcmp(name, "json") == 0)
+    format = RESULTS_JSON;
+  else if (strcmp(name, "csv") == 0)
+    format = RESULTS_CSV;
+  else {
+    if (strcmp(name, "none") != 0)
+      printf("Warning: unknown results format %s, expected json or csv\n", name);
+    format = RESULTS_NONE;
+  }
+  path = option_string("resultsfile", "")[0] != '\0' ? option_string("resultsfile", "") : NULL;
+  clock_gettime(CLOCK_MONOTONIC, &began);
+}
+
+bool results_enabled(void)
+{
+  return format != RESULTS_NONE;
+}
+
+bool results_replace_summary(void)
+{
+  return format != RESULTS_NONE && path == NULL;
+}
+
+static struct field *newfield(const char *name)
+{
+  struct field *f;
+
+  if (nfields == maxfields) {
+    maxfields = maxfields ? 2 * maxfields : 64;
+    fields = realloc(fields, maxfields * sizeof(struct field));
+    if (fields == NULL) {
+      printf("memory allocation for results failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  f = &fields[nfields++];
+  strncpy(f->name, name, sizeof(f->name) - 1);
+  f->name[sizeof(f->name) - 1] = '\0';
+  f->isstring = false;
+  return f;
+}
+
+void results_int(const char *name, long value)
+{
+  if (format != RESULTS_NONE)
+    sprintf(newfield(name)->value, "%ld", value);
+}
+
+void results_double(const char *name, double value)
+{
+  if (format == RESULTS_NONE)
+    return;
+  /* 8 digits show the emulator's floats without noise; neither JSON nor
+     most CSV readers take nan or inf */
+  if (value == value && value <= DBL_MAX && value >= -DBL_MAX)
+    sprintf(newfield(name)->value, "%.8g", value);
+  else
+    strcpy(newfield(name)->value, "null");
+}
+
+void results_string(const char *name, const char *value)
+{
+  struct field *f;
+
+  if (format == RESULTS_NONE)
+    return;
+  f = newfield(name);
+  f->isstring = true;
+  strncpy(f->value, value, sizeof(f->value) - 1);
+  f->value[sizeof(f->value) - 1] = '\0';
+}
+
+/* write a string in quotes: JSON escapes quotes and backslashes with a
+   backslash, CSV doubles quotes */
+static void quoted(FILE *fp, const char *s)
+{
+  putc('"', fp);
+  for (; *s != '\0'; s++) {
+    if (*s == '"')
+      putc(format == RESULTS_JSON ? '\\' : '"', fp);
+    else if (*s == '\\' && format == RESULTS_JSON)
+      putc('\\', fp);
+    putc(*s, fp);
+  }
+  putc('"', fp);
+}
+
+/* write the value of field i */
+static void value(FILE *fp, int i)
+{
+  if (fields[i].isstring)
+    quoted(fp, fields[i].value);
+  else
+    fputs(fields[i].value, fp);
+}
+
+void results_emit(void)
+{
+  struct timespec now;
+  FILE *fp = stdout;
+  int i;
+
+  if (format == RESULTS_NONE)
+    return;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  results_double("runtime_seconds", (now.tv_sec - began.tv_sec) + (now.tv_nsec - began.tv_nsec) / 1e9);
+
+  if (path != NULL && (fp = fopen(path, "a")) == NULL) {
+    printf("can not write results to %s\n", path);
+    return;
+  }
+  if (format == RESULTS_JSON) {
+    putc('{', fp);
+    for (i = 0; i < nfields; i++) {
+      fprintf(fp, "%s\"%s\": ", i > 0 ? ", " : "", fields[i].name);
+      value(fp, i);
+    }
+    fprintf(fp, "}\n");
+  }
+  else {
+    /* the header goes to standard output and to a new file only */
+    if (path == NULL || ftell(fp) == 0) {
+      for (i = 0; i < nfields; i++)
+        fprintf(fp, "%s%s", i > 0 ? "," : "", fields[i].name);
+      putc('\n', fp);
+    }
+    for (i = 0; i < nfields; i++) {
+      if (i > 0)
+        putc(',', fp);
+      value(fp, i);
+    }
+    putc('\n', fp);
+  }
+  if (fp != stdout)
+    fclose(fp);
+  nfields = 0;
+}
@@ -0,0 +1,24 @@
+/* machine readable results, chosen with the results option: "json" for
+   one JSON object per run on a line of its own, or "csv" for a header
+   line and a line of values.  With resultsfile=FILE the record is added
+   to the end of FILE, and a CSV header is only written to an empty
+   file, so a sweep can collect its runs in one place; otherwise the
+   record goes to standard output in place of the summary in words.
+   Fields are added in order with the results_ routines and written
+   together by results_emit(). */
+
+/* read the options and start the wall-clock time of the run */
+extern void results_init(void);
+
+/* whether a record is written at all, and whether it takes the place of
+   the summary on standard output */
+extern bool results_enabled(void);
+extern bool results_replace_summary(void);
+
+/* add a field to the record */
+extern void results_int(const char *name, long value);
+extern void results_double(const char *name, double value);
+extern void results_string(const char *name, const char *value);
+
+/* add the wall-clock seconds since results_init() and write the record */
+extern void results_emit(void);
@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include "emulator.h"
+#include "sendqueue.h"
+#include "checkpoint.h"
+
+/* ******************************************************************
+   Send queue shared by the GBN and SR senders.  Messages that arrive
+   from layer 5 while the send window is full are held here instead of
+   being dropped, and are handed back to the sender as ACKs slide the
+   window.  The queue keeps the statistics reported by the emulator.
+**********************************************************************/
+
+void sendqueue_init(struct sendqueue *q, int capacity)
+{
+  free(q->msgs);
+  free(q->enqtime);
+  q->msgs = NULL;
+  q->enqtime = NULL;
+  q->capacity = capacity > 0 ? capacity : 0;
+  q->first = 0;
+  q->count = 0;
+  if (q->capacity == 0)
+    return;
+
+  q->msgs = malloc(q->capacity * sizeof(struct msg));
+  q->enqtime = malloc(q->capacity * sizeof(float));
+  if (q->msgs == NULL || q->enqtime == NULL) {
+    printf("memory allocation for send queue failed.");
+    exit(EXIT_FAILURE);
+  }
+}
+
+bool sendqueue_full(struct sendqueue *q)
+{
+  return q->count >= q->capacity;
+}
+
+bool sendqueue_empty(struct sendqueue *q)
+{
+  return q->count == 0;
+}
+
+/* add a message at the tail of the queue, returns false if the queue is full */
+bool sendqueue_put(struct sendqueue *q, const struct msg *message)
+{
+  int last;
+
+  if (sendqueue_full(q))
+    return false;
+
+  last = (q->first + q->count) % q->capacity;
+  q->msgs[last] = *message;
+  q->enqtime[last] = get_sim_time();
+  q->count++;
+
+  messages_queued++;
+  if (q->count > sendqueue_maxdepth)
+    sendqueue_maxdepth = q->count;
+  return true;
+}
+
+/* remove the message at the head of the queue, returns false if the queue is empty */
+bool sendqueue_get(struct sendqueue *q, struct msg *message)
+{
+  if (sendqueue_empty(q))
+    return false;
+
+  *message = q->msgs[q->first];
+  sendqueue_delay += get_sim_time() - q->enqtime[q->first];
+  q->first = (q->first + 1) % q->capacity;
+  q->count--;
+  return true;
+}
+
+void sendqueue_save(FILE *fp, const struct sendqueue *q)
+{
+  checkpoint_write(fp, &q->capacity, sizeof(int));
+  checkpoint_write(fp, &q->first, sizeof(int));
+  checkpoint_write(fp, &q->count, sizeof(int));
+  checkpoint_write(fp, q->msgs, q->capacity * sizeof(struct msg));
+  checkpoint_write(fp, q->enqtime, q->capacity * sizeof(float));
+}
+
+void sendqueue_restore(FILE *fp, struct sendqueue *q)
+{
+  int capacity;
+
+  checkpoint_read(fp, &capacity, sizeof(int));
+  if (capacity != q->capacity)
+    checkpoint_mismatch("the sendqueue option differs");
+  checkpoint_read(fp, &q->first, sizeof(int));
+  checkpoint_read(fp, &q->count, sizeof(int));
+  checkpoint_read(fp, q->msgs, q->capacity * sizeof(struct msg));
+  checkpoint_read(fp, q->enqtime, q->capacity * sizeof(float));
+}
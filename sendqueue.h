@@ -0,0 +1,18 @@
+/* a bounded FIFO of layer 5 messages waiting for room in the send window */
+struct sendqueue {
+  struct msg *msgs;     /* circular buffer of queued messages */
+  float *enqtime;       /* time at which each message was queued */
+  int capacity;         /* the maximum number of queued messages */
+  int first;            /* index of the oldest queued message */
+  int count;            /* the number of messages currently queued */
+};
+
+extern void sendqueue_init(struct sendqueue *q, int capacity);
+extern bool sendqueue_full(struct sendqueue *q);
+extern bool sendqueue_empty(struct sendqueue *q);
+extern bool sendqueue_put(struct sendqueue *q, const struct msg *message);
+extern bool sendqueue_get(struct sendqueue *q, struct msg *message);
+
+/* save queue q to a snapshot, or restore it from one, see checkpoint.h */
+extern void sendqueue_save(FILE *fp, const struct sendqueue *q);
+extern void sendqueue_restore(FILE *fp, struct sendqueue *q);
@@ -0,0 +1,200 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "options.h"
+#include "transport.h"
+
+/* ******************************************************************
+   Shared memory transport for the real backend.  A segment made with
+   shm_open() holds two single-producer single-consumer rings, one each
+   way: the sender copies a packet into the next slot and moves the
+   tail on, the receiver copies it out and moves the head on, with no
+   locks and no system calls.  A receiver with nothing to read spins
+   for a while, then sleeps on the ring's tail with a futex; the sender
+   wakes it once per flush, and only if it is asleep.  Losing and
+   corrupting packets is done here, as they enter the ring.
+**********************************************************************/
+
+#define CACHELINE 64
+#define SLOTSIZE 1532               /* the largest packet */
+
+struct slot {
+  int len;
+  char data[SLOTSIZE];
+};
+
+/* head, tail and the sleeping flag each have a cache line of their own,
+   so the producer and the consumer do not write to the same one */
+struct ring {
+  unsigned tail;                    /* slots written, by the producer */
+  char pad1[CACHELINE - sizeof(unsigned)];
+  unsigned head;                    /* slots read, by the consumer */
+  char pad2[CACHELINE - sizeof(unsigned)];
+  int sleeping;                     /* the consumer is waiting on tail */
+  char pad3[CACHELINE - sizeof(int)];
+};
+
+static char *segment;
+static size_t seglen;
+static unsigned nslots;             /* slots in each ring, a power of 2 */
+static struct ring *out, *in;       /* the ring this side writes and the one it reads */
+static struct slot *outslots, *inslots;
+
+static int spin;                    /* polls of an empty ring before sleeping */
+static double loss, corrupt;        /* probabilities of losing and corrupting a packet */
+static unsigned rng;                /* xorshift state for loss and corruption */
+static int pushed;                  /* packets written since the last flush */
+static long calls;                  /* system calls made */
+
+static double uniform(void)
+{
+  rng ^= rng << 13;
+  rng ^= rng >> 17;
+  rng ^= rng << 5;
+  return rng / 4294967296.0;
+}
+
+static long futex(unsigned *addr, int op, unsigned val, const struct timespec *timeout)
+{
+  calls++;
+  return syscall(SYS_futex, addr, op, val, timeout, NULL, 0);
+}
+
+static struct ring *ringat(int i)
+{
+  return (struct ring *)(segment + i * (sizeof(struct ring) + nslots * sizeof(struct slot)));
+}
+
+static void shm_open_side(int AorB)
+{
+  const char *name = option_string("shmname", "/gbn_shm");
+  unsigned n = option_int("shmslots", 1024);
+  int fd;
+
+  for (nslots = 1; nslots < n; nslots *= 2)
+    ;
+  seglen = 2 * (sizeof(struct ring) + nslots * sizeof(struct slot));
+  spin = option_int("shmspin", 1000);
+  loss = option_double("ringloss", 0.0);
+  corrupt = option_double("ringcorrupt", 0.0);
+  rng = 2463534242u + option_int("seed", 9999) * 2 + AorB;
+
+  /* B makes the segment, A attaches to it and removes the name */
+  fd = shm_open(name, AorB == 1 ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0600);
+  if (fd < 0) {
+    perror(name);
+    if (AorB == 0)
+      printf("the B side (role=b) must be started first\n");
+    exit(EXIT_FAILURE);
+  }
+  if (AorB == 1 && ftruncate(fd, seglen) < 0) {
+    perror("ftruncate");
+    exit(EXIT_FAILURE);
+  }
+  segment = mmap(NULL, seglen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, 0);
+  close(fd);
+  if (segment == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  if (AorB == 1)
+    memset(segment, 0, seglen);
+  else
+    shm_unlink(name);
+
+  /* ring 0 carries packets from A to B, ring 1 from B to A */
+  out = ringat(AorB);
+  in = ringat(1 - AorB);
+  outslots = (struct slot *)(out + 1);
+  inslots = (struct slot *)(in + 1);
+  pushed = 0;
+}
+
+static void shm_close(void)
+{
+  munmap(segment, seglen);
+  segment = NULL;
+}
+
+static int shm_send(const void *data, int len)
+{
+  unsigned tail = out->tail;
+  struct slot *s;
+
+  if (len > SLOTSIZE || tail - __atomic_load_n(&out->head, __ATOMIC_ACQUIRE) == nslots)
+    return 0;
+  if (loss > 0.0 && uniform() < loss)
+    return 1;
+  s = &outslots[tail & (nslots - 1)];
+  s->len = len;
+  memcpy(s->data, data, len);
+  /* the flow number in front of the packet is left alone */
+  if (corrupt > 0.0 && len > (int)sizeof(int) && uniform() < corrupt)
+    s->data[sizeof(int) + (int)(uniform() * (len - sizeof(int)))] ^= 0x5a;
+  __atomic_store_n(&out->tail, tail + 1, __ATOMIC_SEQ_CST);
+  pushed++;
+  return 1;
+}
+
+static int shm_flush(void)
+{
+  if (pushed > 0 && __atomic_load_n(&out->sleeping, __ATOMIC_SEQ_CST))
+    futex(&out->tail, FUTEX_WAKE, 1, NULL);
+  pushed = 0;
+  return 0;
+}
+
+static int shm_receive(void *data, int max)
+{
+  unsigned head = in->head;
+  struct slot *s;
+  int len;
+
+  if (head == __atomic_load_n(&in->tail, __ATOMIC_ACQUIRE))
+    return 0;
+  s = &inslots[head & (nslots - 1)];
+  len = s->len < max ? s->len : max;
+  memcpy(data, s->data, len);
+  __atomic_store_n(&in->head, head + 1, __ATOMIC_RELEASE);
+  return len;
+}
+
+static void shm_wait(double timeout)
+{
+  struct timespec ts;
+  unsigned tail;
+  int i;
+
+  for (i = 0; i < spin; i++)
+    if (__atomic_load_n(&in->tail, __ATOMIC_ACQUIRE) != in->head)
+      return;
+  if (timeout <= 0.0)
+    return;
+  ts.tv_sec = (time_t)timeout;
+  ts.tv_nsec = (long)((timeout - ts.tv_sec) * 1e9);
+  /* the flag goes up before the last look at the tail, so a packet
+     written after that look is sure to see it and wake us */
+  __atomic_store_n(&in->sleeping, 1, __ATOMIC_SEQ_CST);
+  tail = __atomic_load_n(&in->tail, __ATOMIC_SEQ_CST);
+  if (tail == in->head)
+    futex(&in->tail, FUTEX_WAIT, tail, &ts);
+  __atomic_store_n(&in->sleeping, 0, __ATOMIC_SEQ_CST);
+}
+
+static long shm_syscalls(void)
+{
+  return calls;
+}
+
+const struct transport shm_transport = {
+  "shm", shm_open_side, shm_close, shm_send, shm_flush, shm_receive, shm_wait, shm_syscalls
+};
@@ -0,0 +1,171 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <time.h>
+#include "emulator.h"
+#include "options.h"
+#include "checkpoint.h"
+#include "results.h"
+#include "stats.h"
+
+/* ******************************************************************
+   Counters for the emulator's hot paths.  The counting is done by the
+   STAT_ macros in stats.h, in place, so this file only reads the
+   options, reads the clock and reports.
+**********************************************************************/
+
+#ifndef NOSTATS
+THREADLOCAL struct stats stats;
+static const char *eventnames[STATS_NEVENTS] = { "timer", "from layer 5", "from layer 3", "from router" };
+#endif
+int stats_timing;
+
+void stats_init(void)
+{
+  stats_timing = option_int("tsc", 0);
+}
+
+unsigned long stats_clock(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  unsigned lo, hi;
+
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((unsigned long)hi << 16 << 16) | lo;
+#else
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+#endif
+}
+
+struct stats *stats_alloc(int n)
+{
+  void *p;
+
+  if (posix_memalign(&p, STATS_CACHELINE, n * sizeof(struct stats)) != 0) {
+    printf("memory allocation for statistics failed.");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+void stats_save(struct stats *into)
+{
+#ifndef NOSTATS
+  *into = stats;
+#else
+  (void)into;
+#endif
+}
+
+void stats_save_state(FILE *fp)
+{
+#ifndef NOSTATS
+  checkpoint_write(fp, &stats, sizeof(struct stats));
+#else
+  (void)fp;
+#endif
+}
+
+void stats_restore_state(FILE *fp)
+{
+#ifndef NOSTATS
+  checkpoint_read(fp, &stats, sizeof(struct stats));
+#else
+  (void)fp;
+#endif
+}
+
+void stats_merge(const struct stats *other)
+{
+#ifndef NOSTATS
+  int i;
+
+  for (i = 0; i < STATS_NEVENTS; i++) {
+    stats.events[i] += other->events[i];
+    stats.ticks[i] += other->ticks[i];
+  }
+  stats.depthsum += other->depthsum;
+  if (other->depthmax > stats.depthmax)
+    stats.depthmax = other->depthmax;
+  stats.timer_starts += other->timer_starts;
+  stats.timer_stops += other->timer_stops;
+  stats.timeouts += other->timeouts;
+  for (i = 0; i < 2; i++) {
+    stats.sent[i] += other->sent[i];
+    stats.lost[i] += other->lost[i];
+    stats.dropped[i] += other->dropped[i];
+    stats.corrupt[i] += other->corrupt[i];
+  }
+  stats.resent_timeout += other->resent_timeout;
+  stats.resent_goback += other->resent_goback;
+#else
+  (void)other;
+#endif
+}
+
+#ifndef NOSTATS
+static unsigned long allevents(void)
+{
+  unsigned long events = 0;
+  int i;
+
+  for (i = 0; i < STATS_NEVENTS; i++)
+    events += stats.events[i];
+  return events;
+}
+#endif
+
+void stats_report(void)
+{
+#ifndef NOSTATS
+  unsigned long events = allevents();
+  int i;
+
+  if (!option_int("stats", 0))
+    return;
+  printf("events handled:  %lu (timer %lu, from layer 5 %lu, from layer 3 %lu, from router %lu) \n",
+         events, stats.events[0], stats.events[1], stats.events[2], stats.events[3]);
+  printf("event list length:  average %f, longest %lu \n",
+         events > 0 ? (double)stats.depthsum / events : 0.0, stats.depthmax);
+  if (stats_timing)
+    for (i = 0; i < STATS_NEVENTS; i++)
+      if (stats.events[i] > 0)
+        printf("ticks per %s event:  %f \n", eventnames[i], (double)stats.ticks[i] / stats.events[i]);
+  printf("timers started:  %lu, stopped:  %lu, expired:  %lu \n",
+         stats.timer_starts, stats.timer_stops, stats.timeouts);
+  printf("packets sent A to B:  %lu, lost %lu, dropped by queues %lu, corrupted %lu \n",
+         stats.sent[A], stats.lost[A], stats.dropped[A], stats.corrupt[A]);
+  printf("packets sent B to A:  %lu, lost %lu, dropped by queues %lu, corrupted %lu \n",
+         stats.sent[B], stats.lost[B], stats.dropped[B], stats.corrupt[B]);
+  printf("retransmissions:  %lu of timed out packets, %lu resent with them by go-back-N \n",
+         stats.resent_timeout, stats.resent_goback);
+#endif
+}
+
+void stats_results(void)
+{
+#ifndef NOSTATS
+  unsigned long events = allevents();
+
+  results_int("events", events);
+  results_double("event_list_average", events > 0 ? (double)stats.depthsum / events : 0.0);
+  results_int("event_list_max", stats.depthmax);
+  results_int("timer_starts", stats.timer_starts);
+  results_int("timer_stops", stats.timer_stops);
+  results_int("timeouts", stats.timeouts);
+  results_int("packets_sent_ab", stats.sent[A]);
+  results_int("packets_sent_ba", stats.sent[B]);
+  results_int("packets_lost_ab", stats.lost[A]);
+  results_int("packets_lost_ba", stats.lost[B]);
+  results_int("packets_dropped_ab", stats.dropped[A]);
+  results_int("packets_dropped_ba", stats.dropped[B]);
+  results_int("packets_corrupt_ab", stats.corrupt[A]);
+  results_int("packets_corrupt_ba", stats.corrupt[B]);
+  results_int("resent_timeout", stats.resent_timeout);
+  results_int("resent_goback", stats.resent_goback);
+#endif
+}
@@ -0,0 +1,66 @@
+/* instrumentation of the emulator's hot paths: events handled by type
+   and the length of the event list, timers, packets sent, lost, dropped
+   by a queue and corrupted in each direction, and retransmissions by
+   cause.  Every thread counts in a copy of its own that starts on a
+   cache line, so the parallel engine's threads never write to the same
+   line; the copies are added up at the end.  With the tsc option the
+   time spent handling each type of event is measured as well, with the
+   time stamp counter where there is one.  The stats option prints the
+   counts.  Building with -DNOSTATS compiles all of it out: the STAT_
+   macros then do nothing and cost nothing. */
+
+#define STATS_CACHELINE 64
+#define STATS_NEVENTS 4           /* event types counted, see emulator.c */
+
+struct stats {
+  unsigned long events[STATS_NEVENTS]; /* events handled, by type */
+  unsigned long ticks[STATS_NEVENTS];  /* ticks spent handling them, with tsc=1 */
+  unsigned long depthsum;         /* event list length, summed over the events */
+  unsigned long depthmax;         /* the longest event list */
+  unsigned long timer_starts, timer_stops, timeouts;
+  unsigned long sent[2];          /* packets, by the side that sent them */
+  unsigned long lost[2];          /* lost by the channel's loss model */
+  unsigned long dropped[2];       /* dropped by a link or router queue */
+  unsigned long corrupt[2];
+  unsigned long resent_timeout;   /* the packet whose timer went off */
+  unsigned long resent_goback;    /* the rest of a GBN window, resent with it */
+} __attribute__((aligned(STATS_CACHELINE)));
+
+#ifdef NOSTATS
+#define STAT_INC(field) ((void)0)
+#define STAT_ADD(field, n) ((void)sizeof(n))
+#define STAT_MAX(field, n) ((void)sizeof(n))
+#else
+extern THREADLOCAL struct stats stats;
+#define STAT_INC(field) (stats.field++)
+#define STAT_ADD(field, n) (stats.field += (n))
+#define STAT_MAX(field, n) (stats.field < (unsigned long)(n) ? (void)(stats.field = (n)) : (void)0)
+#endif
+
+/* read the options */
+extern void stats_init(void);
+
+/* whether handling events is to be timed */
+extern int stats_timing;
+
+/* a tick count: the time stamp counter on x86, nanoseconds elsewhere */
+extern unsigned long stats_clock(void);
+
+/* room for the counts of n threads, on cache lines of their own */
+extern struct stats *stats_alloc(int n);
+
+/* copy this thread's counts to *into, for another thread to add up */
+extern void stats_save(struct stats *into);
+
+/* save or restore the counts with a snapshot, see checkpoint.h */
+extern void stats_save_state(FILE *fp);
+extern void stats_restore_state(FILE *fp);
+
+/* add the counts of another thread to this thread's */
+extern void stats_merge(const struct stats *other);
+
+/* print the counts, if the stats option is 1 */
+extern void stats_report(void);
+
+/* add the counts to the results record, see results.h */
+extern void stats_results(void);
@@ -0,0 +1,49 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include "threads.h"
+
+/* ******************************************************************
+   Worker threads for the parallel engine.  The main thread and the
+   workers meet at a single barrier at the start and the end of every
+   time window.
+**********************************************************************/
+
+static pthread_t *threads;
+static int nthreads;
+static pthread_barrier_t barrier;
+
+void threads_start(int n, void *(*run)(void *), void *args, size_t size)
+{
+  int i;
+
+  threads = malloc(n * sizeof(pthread_t));
+  if (threads == NULL) {
+    printf("memory allocation for threads failed.");
+    exit(EXIT_FAILURE);
+  }
+  nthreads = n;
+  pthread_barrier_init(&barrier, NULL, n + 1);
+  for (i = 0; i < n; i++)
+    if (pthread_create(&threads[i], NULL, run, (char *)args + i * size) != 0) {
+      printf("can not start thread %d\n", i);
+      exit(EXIT_FAILURE);
+    }
+}
+
+void threads_barrier(void)
+{
+  pthread_barrier_wait(&barrier);
+}
+
+void threads_join(void)
+{
+  int i;
+
+  for (i = 0; i < nthreads; i++)
+    pthread_join(threads[i], NULL);
+  pthread_barrier_destroy(&barrier);
+  free(threads);
+  threads = NULL;
+}
@@ -0,0 +1,12 @@
+/* worker threads that run in lock step with the main thread, for the
+   parallel engine.  pthreads are kept out of the emulator, whose time
+   variable would clash with <time.h>. */
+
+/* start n threads, thread i running run(args + i * size) */
+extern void threads_start(int n, void *(*run)(void *), void *args, size_t size);
+
+/* wait until the main thread and every worker thread have reached the barrier */
+extern void threads_barrier(void);
+
+/* wait for the worker threads to return */
+extern void threads_join(void);
@@ -0,0 +1,343 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include "emulator.h"
+#include "options.h"
+#include "link.h"
+#include "loss.h"
+#include "topology.h"
+#include "checkpoint.h"
+
+/* ******************************************************************
+   Multi-hop topology.  The emulator hands each packet to
+   topology_forward() once per hop: the link the packet is on decides
+   whether it is lost or dropped from its queue and when it reaches the
+   next node, and the emulator schedules the packet's arrival there.
+   The protocols at the ends see only the end to end behaviour.
+**********************************************************************/
+
+#define NAMELEN 32
+
+struct tnode {
+  char name[NAMELEN];
+};
+
+struct tlink {
+  int from, to;             /* nodes at the two ends */
+  struct link q;            /* queue, rate and delay */
+  struct lossmodel loss;    /* packets lost on the link */
+};
+
+struct troute {
+  int nhops;                /* number of links on the path, 0 if not known yet */
+  int *links;               /* the links in order */
+};
+
+static struct tnode *nodes;
+static int nnodes;
+static struct tlink *links;
+static int nlinks;
+static struct troute *routes;     /* routes[src * nnodes + dst] */
+static int hostA = -1, hostB = -1; /* where A and B of every flow are attached */
+static int *flowhosts;            /* per flow overrides, 2 * flow + A or B, -1 if none */
+
+static const char *path;          /* the topology file */
+static int lineno;                /* line being read */
+
+static void fail(const char *msg, const char *arg)
+{
+  printf("topology %s line %d: %s %s\n", path, lineno, msg, arg);
+  exit(EXIT_FAILURE);
+}
+
+static void *grow(void *p, int count, size_t size)
+{
+  p = realloc(p, count * size);
+  if (p == NULL) {
+    printf("memory allocation for topology failed.");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+static int findnode(const char *name)
+{
+  int i;
+
+  if (name == NULL)
+    fail("missing node name", "");
+  for (i = 0; i < nnodes; i++)
+    if (strcmp(nodes[i].name, name) == 0)
+      return i;
+  fail("unknown node", name);
+  return -1;
+}
+
+static int findlink(int from, int to)
+{
+  int i;
+
+  for (i = 0; i < nlinks; i++)
+    if (links[i].from == from && links[i].to == to)
+      return i;
+  return -1;
+}
+
+/* add a link from node from to node to, with the key=value settings that follow */
+static void addlink(int from, int to, char *settings)
+{
+  double rate = 10.0, delay = 1.0;
+  int queue = 50;
+  const char *aqm = "droptail", *loss = "none";
+  struct tlink *l;
+  char *tok, *eq;
+
+  for (tok = strtok(settings, " \t\r\n"); tok != NULL; tok = strtok(NULL, " \t\r\n")) {
+    eq = strchr(tok, '=');
+    if (eq == NULL)
+      fail("expected key=value, not", tok);
+    *eq++ = '\0';
+    if (strcmp(tok, "rate") == 0)
+      rate = atof(eq);
+    else if (strcmp(tok, "delay") == 0)
+      delay = atof(eq);
+    else if (strcmp(tok, "queue") == 0)
+      queue = atoi(eq);
+    else if (strcmp(tok, "aqm") == 0)
+      aqm = eq;
+    else if (strcmp(tok, "loss") == 0)
+      loss = eq;
+    else
+      fail("unknown link setting", tok);
+  }
+  if (rate <= 0.0)
+    fail("link rate must be above 0", "");
+  if (findlink(from, to) != -1)
+    fail("duplicate link from", nodes[from].name);
+
+  links = grow(links, nlinks + 1, sizeof(struct tlink));
+  l = &links[nlinks++];
+  memset(l, 0, sizeof(struct tlink));
+  l->from = from;
+  l->to = to;
+  link_setup(&l->q, rate, delay, queue, link_aqm(aqm));
+  if (!lossmodel_init(&l->loss, loss))
+    fail("bad loss model", loss);
+}
+
+/* set the route along the nodes named in the rest of the line */
+static void addroute(void)
+{
+  struct troute *r;
+  int hops[256];
+  int n = 0, from, to, src;
+  char *tok;
+
+  src = from = findnode(strtok(NULL, " \t\r\n"));
+  while ((tok = strtok(NULL, " \t\r\n")) != NULL) {
+    to = findnode(tok);
+    if (n == 256)
+      fail("route too long at", tok);
+    if ((hops[n++] = findlink(from, to)) == -1)
+      fail("no link on route to", tok);
+    from = to;
+  }
+  if (n == 0)
+    fail("route needs two nodes or more", "");
+  r = &routes[src * nnodes + from];
+  free(r->links);
+  r->links = grow(NULL, n, sizeof(int));
+  memcpy(r->links, hops, n * sizeof(int));
+  r->nhops = n;
+}
+
+/* the path with the fewest hops from src to dst, by breadth first search */
+static struct troute *findroute(int src, int dst)
+{
+  struct troute *r = &routes[src * nnodes + dst];
+  int *via, *queue;
+  int head = 0, tail = 0, n, i, node;
+
+  if (r->nhops > 0)
+    return r;
+  via = grow(NULL, nnodes, sizeof(int));     /* link used to reach each node */
+  queue = grow(NULL, nnodes, sizeof(int));
+  for (i = 0; i < nnodes; i++)
+    via[i] = -1;
+  queue[tail++] = src;
+  while (head < tail && via[dst] == -1) {
+    node = queue[head++];
+    for (i = 0; i < nlinks; i++)
+      if (links[i].from == node && links[i].to != src && via[links[i].to] == -1) {
+        via[links[i].to] = i;
+        queue[tail++] = links[i].to;
+      }
+  }
+  if (via[dst] == -1) {
+    printf("topology %s: no path from %s to %s\n", path, nodes[src].name, nodes[dst].name);
+    exit(EXIT_FAILURE);
+  }
+  for (n = 0, node = dst; node != src; node = links[via[node]].from)
+    n++;
+  r->links = grow(NULL, n, sizeof(int));
+  r->nhops = n;
+  for (node = dst; node != src; node = links[via[node]].from)
+    r->links[--n] = via[node];
+  free(via);
+  free(queue);
+  return r;
+}
+
+void topology_init(void)
+{
+  char line[1024], rest[1024];
+  char *cmd;
+  FILE *fp;
+  int i, flow;
+
+  path = option_string("topology", "");
+  if (path[0] == '\0')
+    return;
+  fp = fopen(path, "r");
+  if (fp == NULL) {
+    printf("topology %s: can not open file\n", path);
+    exit(EXIT_FAILURE);
+  }
+
+  flowhosts = grow(NULL, 2 * flow_count(), sizeof(int));
+  for (i = 0; i < 2 * flow_count(); i++)
+    flowhosts[i] = -1;
+
+  for (lineno = 1; fgets(line, sizeof(line), fp) != NULL; lineno++) {
+    if (strchr(line, '#') != NULL)
+      *strchr(line, '#') = '\0';
+    cmd = strtok(line, " \t\r\n");
+    if (cmd == NULL)
+      continue;
+
+    if (strcmp(cmd, "node") == 0) {
+      cmd = strtok(NULL, " \t\r\n");
+      if (cmd == NULL || strlen(cmd) >= NAMELEN)
+        fail("bad node name", cmd ? cmd : "");
+      if (routes != NULL)
+        fail("nodes must come before links and routes", cmd);
+      nodes = grow(nodes, nnodes + 1, sizeof(struct tnode));
+      strcpy(nodes[nnodes++].name, cmd);
+      continue;
+    }
+
+    /* the first link or route fixes the set of nodes */
+    if (routes == NULL && nnodes > 0) {
+      routes = grow(NULL, nnodes * nnodes, sizeof(struct troute));
+      memset(routes, 0, nnodes * nnodes * sizeof(struct troute));
+    }
+
+    if (strcmp(cmd, "link") == 0 || strcmp(cmd, "duplex") == 0) {
+      int from = findnode(strtok(NULL, " \t\r\n"));
+      int to = findnode(strtok(NULL, " \t\r\n"));
+      char *settings = strtok(NULL, "\r\n");
+      char copy[1024];
+
+      /* strtok is not reentrant, so the settings are parsed from a copy */
+      strcpy(copy, settings ? settings : "");
+      strcpy(rest, copy);
+      addlink(from, to, copy);
+      if (strcmp(cmd, "duplex") == 0)
+        addlink(to, from, rest);
+    }
+    else if (strcmp(cmd, "route") == 0)
+      addroute();
+    else if (strcmp(cmd, "hosts") == 0) {
+      hostA = findnode(strtok(NULL, " \t\r\n"));
+      hostB = findnode(strtok(NULL, " \t\r\n"));
+    }
+    else if (strcmp(cmd, "flow") == 0) {
+      cmd = strtok(NULL, " \t\r\n");
+      flow = cmd ? atoi(cmd) : -1;
+      if (flow < 0 || flow >= flow_count())
+        fail("no such flow", cmd ? cmd : "");
+      flowhosts[2 * flow + A] = findnode(strtok(NULL, " \t\r\n"));
+      flowhosts[2 * flow + B] = findnode(strtok(NULL, " \t\r\n"));
+    }
+    else
+      fail("unknown statement", cmd);
+  }
+  fclose(fp);
+
+  if (routes == NULL)
+    fail("no links", "");
+  for (i = 0; i < 2 * flow_count(); i++)
+    if (flowhosts[i] == -1 && (flowhosts[i] = i % 2 == A ? hostA : hostB) == -1)
+      fail("no hosts given for flow", "");
+}
+
+bool topology_enabled(void)
+{
+  return routes != NULL;
+}
+
+double topology_lookahead(void)
+{
+  double least = links[0].q.propdelay;
+  int i;
+
+  for (i = 1; i < nlinks; i++)
+    if (links[i].q.propdelay < least)
+      least = links[i].q.propdelay;
+  return least;
+}
+
+int topology_forward(int flow, int AorB, int hop, double now, int bytes, double *arrival)
+{
+  struct troute *r = findroute(flowhosts[2 * flow + AorB], flowhosts[2 * flow + (AorB + 1) % 2]);
+  struct tlink *l = &links[r->links[hop]];
+
+  if (lossmodel_drop(&l->loss)) {
+    if (TRACE > 0)
+      printf("          TOLAYER3: packet being lost on link %s->%s\n", nodes[l->from].name, nodes[l->to].name);
+    return -1;
+  }
+  if (!link_enqueue(&l->q, now, bytes, arrival))
+    return -1;
+  return r->nhops - hop - 1;
+}
+
+void topology_report(double end)
+{
+  char name[2 * NAMELEN + 2];
+  int i;
+
+  if (!topology_enabled())
+    return;
+  for (i = 0; i < nlinks; i++) {
+    sprintf(name, "%s->%s", nodes[links[i].from].name, nodes[links[i].to].name);
+    link_print(name, &links[i].q, end);
+    if (links[i].loss.model != LOSS_NONE)
+      lossmodel_print(name, &links[i].loss);
+  }
+}
+
+void topology_save_state(FILE *fp)
+{
+  int i;
+
+  checkpoint_write(fp, &nlinks, sizeof(int));
+  for (i = 0; i < nlinks; i++) {
+    link_save(fp, &links[i].q);
+    lossmodel_save(fp, &links[i].loss);
+  }
+}
+
+void topology_restore_state(FILE *fp)
+{
+  int i, n;
+
+  checkpoint_read(fp, &n, sizeof(int));
+  if (n != nlinks)
+    checkpoint_mismatch("the topology differs");
+  for (i = 0; i < nlinks; i++) {
+    link_restore(fp, &links[i].q);
+    lossmodel_restore(fp, &links[i].loss);
+  }
+}
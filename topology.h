@@ -0,0 +1,33 @@
+/* multi-hop topologies of store-and-forward routers, read from the file
+   given by the topology option.  One statement per line, # starts a comment:
+     node NAME                     a host or router
+     link FROM TO [key=value ...]  a one-way link from node FROM to node TO
+     duplex X Y [key=value ...]    a link each way between X and Y
+     route NODE NODE ... NODE      the path from the first to the last node
+     hosts NODEA NODEB             where A and B of every flow are attached
+     flow N NODEA NODEB            where A and B of flow N are attached
+   Links take rate (bytes per time unit, default 10), delay (default 1),
+   queue (packets, default 50), aqm (droptail, red or codel) and loss (a
+   loss model spec, see lossmodel_init(), default none).  A pair of nodes
+   without a route uses the path with the fewest hops.  Packets pass hop by
+   hop through the event list, queueing at each link they use. */
+
+extern void topology_init(void);
+extern bool topology_enabled(void);
+
+/* the least time a packet can take to cross any link, the smallest
+   propagation delay */
+extern double topology_lookahead(void);
+
+/* move a packet of bytes bytes sent by A or B of flow across the link that
+   is hop links along its path, at time now.  Returns -1 if the link drops
+   the packet, otherwise sets *arrival to the time it reaches the far end of
+   the link and returns the number of links still ahead of it. */
+extern int topology_forward(int flow, int AorB, int hop, double now, int bytes, double *arrival);
+
+/* save or restore the queues and loss models of every link, see checkpoint.h */
+extern void topology_save_state(FILE *fp);
+extern void topology_restore_state(FILE *fp);
+
+/* print the statistics of every link, the simulation ended at time end */
+extern void topology_report(double end);
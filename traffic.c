@@ -0,0 +1,291 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include "emulator.h"
+#include "options.h"
+#include "checkpoint.h"
+#include "traffic.h"
+
+/* ******************************************************************
+   Layer 5 traffic sources used by generate_next_arrival().  A flow's
+   source keeps the layer 5 messages still to come of the application
+   message being sent, which arrive at once, and the state of its ON/OFF
+   process and its place in a trace.  The parallel engine calls a flow's
+   source only from the thread running that flow, and every flow has
+   its own state, so no locks are needed.
+**********************************************************************/
+
+extern double jimsrand(void);   /* the emulator's random number generator */
+
+struct source {
+  int pending;                  /* layer 5 messages of the current one still to arrive */
+  int side;                     /* the side the current one arrives at */
+  bool on;                      /* ON/OFF source is in an ON period */
+  double periodend;             /* when the current ON or OFF period ends, -1 before the first */
+  int tracepos;                 /* next line of the trace */
+
+  /* statistics */
+  int messages;                 /* application messages made */
+  double bytes;                 /* their total size */
+  int replayed;                 /* arrivals taken from a replay log instead */
+};
+
+static enum traffic_model model;
+static enum size_model sizemodel;
+static double mean;             /* mean time between application messages */
+static double bmixprob;         /* fraction of messages that arrive at B */
+static double onmean, offmean;  /* mean lengths of ON and OFF periods */
+static double alpha;            /* shape of the Pareto times */
+static double sizemean, sizemin, sizemax, sizealpha;
+static struct source *sources;
+static int nsources;
+
+static double *traceinterval;   /* trace: times between messages ... */
+static double *tracesize;       /* ... and their sizes, 0 if not given */
+static int tracelen;
+
+/* read a traffic trace, returns false if there is none in the file */
+static bool loadtrace(const char *path)
+{
+  char line[256];
+  FILE *fp;
+  double d, s;
+  int capacity = 0, n;
+
+  fp = fopen(path, "r");
+  if (fp == NULL)
+    return false;
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    n = sscanf(line, "%lf %lf", &d, &s);
+    if (n < 1)
+      continue;
+    if (tracelen == capacity) {
+      capacity = capacity ? 2 * capacity : 64;
+      traceinterval = realloc(traceinterval, capacity * sizeof(double));
+      tracesize = realloc(tracesize, capacity * sizeof(double));
+      if (traceinterval == NULL || tracesize == NULL) {
+        printf("memory allocation for traffic trace failed.");
+        exit(EXIT_FAILURE);
+      }
+    }
+    traceinterval[tracelen] = d;
+    tracesize[tracelen] = n == 2 ? s : 0.0;
+    tracelen++;
+  }
+  fclose(fp);
+  return tracelen > 0;
+}
+
+void traffic_init(int nflows, float lambda, double bmix)
+{
+  const char *name;
+
+  mean = lambda;
+  bmixprob = bmix;
+  onmean = option_double("on_mean", 10.0 * mean);
+  offmean = option_double("off_mean", 10.0 * mean);
+  alpha = option_double("traffic_alpha", 1.5);
+  if (alpha <= 1.0) {
+    printf("traffic_alpha must be above 1 for the mean to be lambda\n");
+    exit(EXIT_FAILURE);
+  }
+  name = option_string("traffic", "uniform");
+  if (strcmp(name, "deterministic") == 0)
+    model = TRAFFIC_DETERMINISTIC;
+  else if (strcmp(name, "poisson") == 0)
+    model = TRAFFIC_POISSON;
+  else if (strcmp(name, "onoff") == 0)
+    model = TRAFFIC_ONOFF;
+  else if (strcmp(name, "pareto") == 0)
+    model = TRAFFIC_PARETO;
+  else if (strcmp(name, "trace") == 0) {
+    model = TRAFFIC_TRACE;
+    if (!loadtrace(option_string("traffictrace", "traffic.txt"))) {
+      printf("Warning: can not read traffic trace %s, using uniform\n",
+             option_string("traffictrace", "traffic.txt"));
+      model = TRAFFIC_UNIFORM;
+    }
+  }
+  else {
+    if (strcmp(name, "uniform") != 0)
+      printf("Warning: unknown traffic model %s, using uniform\n", name);
+    model = TRAFFIC_UNIFORM;
+  }
+
+  sizemean = option_double("msgsize_mean", MSGSIZE);
+  sizemin = option_double("msgsize_min", 1.0);
+  sizemax = option_double("msgsize_max", 2.0 * sizemean - sizemin);
+  sizealpha = option_double("msgsize_alpha", 1.5);
+  name = option_string("msgsize", "fixed");
+  if (strcmp(name, "uniform") == 0)
+    sizemodel = SIZE_UNIFORM;
+  else if (strcmp(name, "exponential") == 0)
+    sizemodel = SIZE_EXPONENTIAL;
+  else if (strcmp(name, "pareto") == 0 && sizealpha > 1.0)
+    sizemodel = SIZE_PARETO;
+  else {
+    if (strcmp(name, "fixed") != 0)
+      printf("Warning: unknown message size model %s, using fixed\n", name);
+    sizemodel = SIZE_FIXED;
+  }
+
+  nsources = nflows;
+  sources = calloc(nflows, sizeof(struct source));
+  if (sources == NULL) {
+    printf("memory allocation for traffic sources failed.");
+    exit(EXIT_FAILURE);
+  }
+}
+
+/* an exponential with mean m */
+static double exponential(double m)
+{
+  double u = jimsrand();
+
+  /* jimsrand() can return 1, which has no finite exponential */
+  return -m * log(u < 1.0 ? 1.0 - u : 1e-9);
+}
+
+/* a Pareto with shape a and mean m */
+static double pareto(double m, double a)
+{
+  double u = jimsrand();
+
+  return m * (a - 1.0) / a / pow(u < 1.0 ? 1.0 - u : 1e-9, 1.0 / a);
+}
+
+/* the size in bytes of a new application message */
+static double drawsize(void)
+{
+  switch (sizemodel) {
+  case SIZE_UNIFORM:
+    return sizemin + (sizemax - sizemin) * jimsrand();
+  case SIZE_EXPONENTIAL:
+    return exponential(sizemean);
+  case SIZE_PARETO:
+    return pareto(sizemean, sizealpha);
+  case SIZE_FIXED:
+  default:
+    return sizemean;
+  }
+}
+
+/* the time from now to the next arrival of an ON/OFF source */
+static double onoff(struct source *s, double now)
+{
+  double t = now;
+
+  if (s->periodend < 0.0) {
+    s->on = true;
+    s->periodend = now + exponential(onmean);
+  }
+  for (;;) {
+    if (s->on) {
+      t += exponential(mean);
+      if (t < s->periodend)
+        return t - now;
+      /* the ON period ended first: nothing arrives until the next one */
+      t = s->periodend;
+      s->on = false;
+      s->periodend = t + exponential(offmean);
+    }
+    else {
+      t = s->periodend;
+      s->on = true;
+      s->periodend = t + exponential(onmean);
+    }
+  }
+}
+
+double traffic_next(int flow, double now, int *side)
+{
+  struct source *s = &sources[flow];
+  double interval, size = 0.0;
+  int n;
+
+  /* the rest of an application message arrives along with its start */
+  if (s->pending > 0) {
+    s->pending--;
+    *side = s->side;
+    return 0.0;
+  }
+  switch (model) {
+  case TRAFFIC_DETERMINISTIC:
+    interval = mean;
+    break;
+  case TRAFFIC_POISSON:
+    interval = exponential(mean);
+    break;
+  case TRAFFIC_ONOFF:
+    interval = onoff(s, now);
+    break;
+  case TRAFFIC_PARETO:
+    interval = pareto(mean, alpha);
+    break;
+  case TRAFFIC_TRACE:
+    interval = traceinterval[s->tracepos];
+    size = tracesize[s->tracepos];
+    s->tracepos = (s->tracepos + 1) % tracelen;
+    break;
+  case TRAFFIC_UNIFORM:
+  default:
+    interval = mean * jimsrand() * 2;  /* uniform on [0,2*lambda] */
+    break;
+  }
+  s->side = bmixprob > 0.0 && jimsrand() < bmixprob ? B : A;
+  *side = s->side;
+  if (size <= 0.0)
+    size = drawsize();
+  n = (int)ceil(size / MSGSIZE);
+  if (n < 1)
+    n = 1;
+  s->pending = n - 1;
+  s->messages++;
+  s->bytes += size;
+  return interval;
+}
+
+void traffic_replayed(int flow)
+{
+  sources[flow].replayed++;
+}
+
+void traffic_save_state(FILE *fp)
+{
+  checkpoint_write(fp, sources, nsources * sizeof(struct source));
+}
+
+void traffic_restore_state(FILE *fp)
+{
+  int i;
+
+  checkpoint_read(fp, sources, nsources * sizeof(struct source));
+  for (i = 0; i < nsources; i++)
+    if (model == TRAFFIC_TRACE && sources[i].tracepos >= tracelen)
+      checkpoint_mismatch("the traffic trace is shorter");
+}
+
+void traffic_report(void)
+{
+  static const char *names[] = { "uniform", "deterministic", "poisson", "onoff", "pareto", "trace" };
+  double bytes = 0.0;
+  int i, messages = 0, replayed = 0;
+
+  if (model == TRAFFIC_UNIFORM && sizemodel == SIZE_FIXED && sizemean == MSGSIZE)
+    return;
+  for (i = 0; i < nsources; i++) {
+    messages += sources[i].messages;
+    bytes += sources[i].bytes;
+    replayed += sources[i].replayed;
+  }
+  printf("traffic source:  %s \n", names[model]);
+  if (messages > 0 || replayed == 0)
+    printf("number of application messages:  %d, average size in bytes:  %f \n",
+           messages, messages > 0 ? bytes / messages : 0.0);
+  /* the log holds when each layer 5 message arrived, not the sizes of
+     the application messages they were part of */
+  if (replayed > 0)
+    printf("layer 5 messages replayed from the log instead:  %d \n", replayed);
+}
@@ -0,0 +1,49 @@
+/* layer 5 traffic sources, chosen with the traffic option.  Every flow
+   has a source of its own, with mean time lambda (read from standard
+   input) between application messages:
+     "uniform"        the time between messages is uniform on
+                      [0, 2 * lambda], as in the original emulator
+     "deterministic"  a message every lambda
+     "poisson"        exponential times between messages
+     "onoff"          Markov-modulated: exponential ON periods with mean
+                      on_mean and OFF periods with mean off_mean; messages
+                      arrive as a Poisson stream during ON periods only
+     "pareto"         Pareto times between messages with shape
+                      traffic_alpha, so a few long gaps separate bursts
+                      of short ones
+     "trace"          replays the file given by traffictrace, one line
+                      per message: the time since the previous message
+                      and, optionally, its size; the trace repeats
+   Each application message has a size in bytes, chosen with the msgsize
+   option: "fixed" (msgsize_mean, default MSGSIZE), "uniform" (on
+   [msgsize_min, msgsize_max]), "exponential" (mean msgsize_mean) or
+   "pareto" (mean msgsize_mean, shape msgsize_alpha).  A trace's sizes
+   take the place of the distribution.  A message of size bytes arrives
+   as ceil(size / MSGSIZE) layer 5 messages at the same time, all at the
+   same side. */
+
+enum traffic_model { TRAFFIC_UNIFORM, TRAFFIC_DETERMINISTIC, TRAFFIC_POISSON, TRAFFIC_ONOFF,
+                     TRAFFIC_PARETO, TRAFFIC_TRACE };
+enum size_model { SIZE_FIXED, SIZE_UNIFORM, SIZE_EXPONENTIAL, SIZE_PARETO };
+
+/* read the options for nflows flows with mean time lambda between
+   messages, a fraction bmix of which arrive at B */
+extern void traffic_init(int nflows, float lambda, double bmix);
+
+/* the time from now until the next layer 5 message of a flow, and in
+   *side the side it arrives at.  Each call takes the random numbers it
+   needs from the emulator's jimsrand(), and the default source takes
+   the same ones the original emulator did. */
+extern double traffic_next(int flow, double now, int *side);
+
+/* count a layer 5 message of flow whose arrival came from a replay log,
+   not from its source */
+extern void traffic_replayed(int flow);
+
+/* save or restore the state of every flow's source, see checkpoint.h */
+extern void traffic_save_state(FILE *fp);
+extern void traffic_restore_state(FILE *fp);
+
+/* print the application messages made and their sizes, and the arrivals
+   replayed instead, unless the sources are the original ones */
+extern void traffic_report(void);
@@ -0,0 +1,592 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "emulator.h"
+#include "gbn.h"
+#include "options.h"
+#include "transport.h"
+#include "filexfer.h"
+
+/* ******************************************************************
+   Real network backend.  Instead of the emulator, this runs the
+   unchanged GBN or SR code as two processes, A and B, that carry their
+   packets over a real transport, UDP on the loopback address by
+   default, with timers on the monotonic clock.  One time unit is
+   timeunit microseconds, 1000 by default, so the protocols' RTT of 16
+   is 16 ms.  A sends the messages option's number of messages, one
+   every interval time units or, with interval=0, as fast as its window
+   lets it, and B reports the rate and the latency of their delivery.
+   A userspace shim can lose or hold back the packets a side sends.
+   With the sendfile option the messages carry a file instead, see
+   filexfer.h, and B reports the file's goodput.
+
+   With role=both (the default) the program forks and runs both sides;
+   role=a and role=b run one side each, for two separate programs.
+**********************************************************************/
+
+int TRACE = 0;
+
+THREADLOCAL int total_ACKs_received = 0;
+THREADLOCAL int packets_resent = 0;
+THREADLOCAL int new_ACKs = 0;
+THREADLOCAL int packets_received = 0;
+THREADLOCAL int window_full = 0;
+THREADLOCAL int acks_sent = 0;
+THREADLOCAL int acks_piggybacked = 0;
+THREADLOCAL int packets_buffered = 0;
+THREADLOCAL int messages_queued = 0;
+THREADLOCAL int sendqueue_maxdepth = 0;
+THREADLOCAL double sendqueue_delay = 0.0;
+
+static const struct transport *transports[] = { &udp_transport, &uring_transport, &shm_transport };
+
+static const struct transport *tp;
+static int side;                  /* the side this process runs, A or B */
+static double start;              /* time 0 on the monotonic clock */
+static double unit;               /* seconds per time unit */
+
+/* one A/B pair of protocol instances, a connection */
+struct conn {
+  bool running[2];                /* the timers of A and B */
+  unsigned timergen[2];           /* bumped when a timer starts, to retire its old heap entry */
+  bool blocked;                   /* A's layer 5 has been asked to hold back */
+  int generated;                  /* messages given to A_output() */
+  int expected;                   /* number of the next message B expects */
+};
+
+static struct conn *conns;
+static int nflows;
+static int curflow;               /* flow of the packet or timer being handled */
+static int nready;                /* flows that A can give a message to */
+static int rr;                    /* the flow offered the next message */
+static int atimers;               /* timers running at A */
+
+/* the running timers of every flow are kept in a binary heap ordered by
+   expiry.  Stopping a timer leaves its entry behind, to be dropped when
+   it reaches the top, so starting and stopping one is cheap. */
+struct timeout {
+  double expiry;                  /* in seconds */
+  int entity;                     /* 2 * flow + A or B */
+  unsigned gen;                   /* the timergen it was started with */
+};
+
+static struct timeout *heap;
+static int heaplen, heapcap;
+
+/* what goes over the transport, a packet and the flow it belongs to */
+struct wire {
+  int flow;
+  struct pkt packet;
+};
+
+#define WIREHEADER ((int)sizeof(int))
+
+static int nmessages;             /* messages A sends, shared out between the flows */
+static double interval;           /* seconds between messages, 0 to send at will */
+static double nextgen;            /* when A sends the next message */
+
+/* the userspace shim */
+static double shimloss;           /* probability that a packet is lost */
+static double shimdelay;          /* seconds a packet is held back */
+
+struct held {
+  double release;                 /* when the packet is sent */
+  int len;
+  struct wire w;
+};
+
+static struct held *heldq;        /* packets held back, a circular FIFO */
+static int heldcap, heldhead, heldcount;
+
+/* statistics */
+static int generated;             /* messages given to A_output() by all flows */
+static int packets_sent;          /* packets handed to the transport */
+static int send_failed;           /* packets the transport could not send */
+static int shim_lost;             /* packets lost by the shim */
+static int packets_in;            /* packets received */
+static int malformed;             /* packets received with a bad length */
+static int delivered;             /* messages delivered at B */
+static int misordered;            /* messages not delivered in order */
+static double latency_sum, latency_max;
+static double firstdelivery, lastdelivery;
+
+/* seconds on the monotonic clock, which both sides share */
+static double clocknow(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static double now(void)
+{
+  return clocknow() - start;
+}
+
+float get_sim_time(void)
+{
+  return (float)(now() / unit);
+}
+
+int flow_count(void)
+{
+  return nflows;
+}
+
+int current_flow(void)
+{
+  return curflow;
+}
+
+/* the messages flow sends */
+static int share(int flow)
+{
+  return nmessages / nflows + (flow < nmessages % nflows);
+}
+
+/* A of flow can take another message */
+static bool ready(int flow)
+{
+  return !conns[flow].blocked && conns[flow].generated < share(flow);
+}
+
+static void heappush(double expiry, int entity, unsigned gen)
+{
+  int i, parent;
+
+  if (heaplen == heapcap) {
+    heapcap = heapcap ? 2 * heapcap : 64;
+    heap = realloc(heap, heapcap * sizeof(struct timeout));
+    if (heap == NULL) {
+      printf("memory allocation for timers failed.");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (i = heaplen++; i > 0 && heap[parent = (i - 1) / 2].expiry > expiry; i = parent)
+    heap[i] = heap[parent];
+  heap[i].expiry = expiry;
+  heap[i].entity = entity;
+  heap[i].gen = gen;
+}
+
+static void heappop(void)
+{
+  struct timeout last = heap[--heaplen];
+  int i = 0, child;
+
+  while ((child = 2 * i + 1) < heaplen) {
+    if (child + 1 < heaplen && heap[child + 1].expiry < heap[child].expiry)
+      child++;
+    if (heap[child].expiry >= last.expiry)
+      break;
+    heap[i] = heap[child];
+    i = child;
+  }
+  heap[i] = last;
+}
+
+/* the timer of a heap entry has been stopped or started again since */
+static bool stale(const struct timeout *x)
+{
+  const struct conn *c = &conns[x->entity / 2];
+
+  return !c->running[x->entity % 2] || c->timergen[x->entity % 2] != x->gen;
+}
+
+void starttimer(int AorB, double increment)
+{
+  struct conn *c = &conns[curflow];
+
+  if (TRACE > 2)
+    printf("          START TIMER: starting timer at %f\n", get_sim_time());
+  if (c->running[AorB]) {
+    printf("Warning: attempt to start a timer that is already started\n");
+    return;
+  }
+  c->running[AorB] = true;
+  atimers += AorB == A;
+  heappush(now() + increment * unit, 2 * curflow + AorB, ++c->timergen[AorB]);
+}
+
+void stoptimer(int AorB)
+{
+  struct conn *c = &conns[curflow];
+
+  if (TRACE > 2)
+    printf("          STOP TIMER: stopping timer at %f\n", get_sim_time());
+  if (!c->running[AorB]) {
+    printf("Warning: unable to cancel your timer. It wasn't running.\n");
+    return;
+  }
+  c->running[AorB] = false;
+  atimers -= AorB == A;
+}
+
+void layer5_backpressure(int AorB, int on)
+{
+  bool was;
+
+  if (AorB != A)
+    return;
+  was = ready(curflow);
+  conns[curflow].blocked = on != 0;
+  nready += ready(curflow) - was;
+}
+
+static void transmit(const struct wire *w, int len)
+{
+  packets_sent++;
+  if (!tp->send(w, len))
+    send_failed++;
+}
+
+void tolayer3(int AorB, const struct pkt *packet)
+{
+  int len = WIREHEADER + PKTHEADER + packet->length;
+  struct wire w;
+  struct held *h;
+
+  if (shimloss > 0.0 && rand() < shimloss * ((double)RAND_MAX + 1.0)) {
+    shim_lost++;
+    if (TRACE > 0)
+      printf("          TOLAYER3: packet from %s being lost\n", AorB == A ? "A" : "B");
+    return;
+  }
+  if (shimdelay <= 0.0) {
+    w.flow = curflow;
+    memcpy(&w.packet, packet, len - WIREHEADER);
+    transmit(&w, len);
+    return;
+  }
+  if (heldcount == heldcap) {
+    /* unwrap the queue into a bigger one */
+    struct held *q = malloc(2 * (heldcap ? heldcap : 64) * sizeof(struct held));
+    int i;
+
+    if (q == NULL) {
+      printf("memory allocation for held packets failed.");
+      exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < heldcount; i++)
+      q[i] = heldq[(heldhead + i) % heldcap];
+    free(heldq);
+    heldq = q;
+    heldcap = 2 * (heldcap ? heldcap : 64);
+    heldhead = 0;
+  }
+  h = &heldq[(heldhead + heldcount++) % heldcap];
+  h->release = now() + shimdelay;
+  h->len = len;
+  h->w.flow = curflow;
+  memcpy(&h->w.packet, packet, len - WIREHEADER);
+}
+
+/* send the held packets whose time has come */
+static void release(double t)
+{
+  while (heldcount > 0 && heldq[heldhead].release <= t) {
+    transmit(&heldq[heldhead].w, heldq[heldhead].len);
+    heldhead = (heldhead + 1) % heldcap;
+    heldcount--;
+  }
+}
+
+/* A stamps every message with the time it was made and its number */
+static void makemessage(struct msg *message, double t, int number)
+{
+  int i;
+
+  for (i = 0; i < MSGSIZE; i++)
+    message->data[i] = 'a' + (number + i) % 26;
+  memcpy(message->data, &t, sizeof(double));
+  memcpy(message->data + sizeof(double), &number, sizeof(int));
+}
+
+void tolayer5(int AorB, const char datasent[MSGSIZE])
+{
+  struct conn *c = &conns[curflow];
+  double t = now(), stamp, latency;
+  int number;
+
+  if (file_enabled()) {
+    if (delivered++ == 0)
+      firstdelivery = t;
+    lastdelivery = t;
+    file_deliver(datasent);
+    return;
+  }
+  memcpy(&stamp, datasent, sizeof(double));
+  memcpy(&number, datasent + sizeof(double), sizeof(int));
+  if (TRACE > 2)
+    printf("          TOLAYER5: message %d received at %s\n", number, AorB == A ? "A" : "B");
+  if (delivered++ == 0)
+    firstdelivery = t;
+  lastdelivery = t;
+  if (number != c->expected)
+    misordered++;
+  c->expected = number + 1;
+  latency = t + start - stamp;
+  latency_sum += latency;
+  if (latency > latency_max)
+    latency_max = latency;
+}
+
+/* give A's layer 4 the messages that are due, taking the flows in turn */
+static void generate(double t)
+{
+  struct msg message;
+  struct conn *c;
+  int n;
+
+  for (n = 0; n < nflows && nready > 0 && (interval <= 0.0 || t >= nextgen); n++) {
+    curflow = rr;
+    rr = (rr + 1) % nflows;
+    c = &conns[curflow];
+    while (ready(curflow) && (interval <= 0.0 || t >= nextgen)) {
+      if (file_enabled())
+        file_message(c->generated * nflows + curflow, &message);
+      else
+        makemessage(&message, clocknow(), c->generated);
+      generated++;
+      c->generated++;
+      nready -= !ready(curflow);
+      A_output(&message);
+      /* a paced message goes to one flow, the next to the next */
+      if (interval > 0.0) {
+        nextgen += interval;
+        break;
+      }
+    }
+  }
+}
+
+/* call the handlers of the timers that have expired */
+static void expire(double t)
+{
+  struct timeout x;
+
+  while (heaplen > 0 && (stale(&heap[0]) || heap[0].expiry <= t)) {
+    x = heap[0];
+    heappop();
+    if (stale(&x))
+      continue;
+    curflow = x.entity / 2;
+    conns[curflow].running[x.entity % 2] = false;
+    atimers -= x.entity % 2 == A;
+    if (TRACE > 1)
+      printf("\nEVENT time: %f,  type: 0, entity: %d\n", t / unit, x.entity);
+    if (x.entity % 2 == A)
+      A_timerinterrupt();
+    else
+      B_timerinterrupt();
+  }
+}
+
+/* the earliest time something other than a packet arrival is due */
+static double nextwake(double t)
+{
+  double next = t + 0.1;
+
+  while (heaplen > 0 && stale(&heap[0]))
+    heappop();
+  if (heaplen > 0 && heap[0].expiry < next)
+    next = heap[0].expiry;
+  if (side == A && nready > 0 && nextgen < next)
+    next = nextgen;
+  if (heldcount > 0 && heldq[heldhead].release < next)
+    next = heldq[heldhead].release;
+  return next;
+}
+
+static void run(void)
+{
+  double idle = option_double("idle", 2.0);                /* seconds */
+  double linger = option_double("linger", 4 * 16.0) * unit; /* time units */
+  double t, heard;
+  struct wire w;
+  int len, got;
+
+  nextgen = now();
+  heard = now();
+  for (;;) {
+    t = now();
+    if (side == A)
+      generate(t);
+    expire(t);
+    release(t);
+
+    /* one clock reading covers every packet of the round */
+    got = 0;
+    while ((len = tp->receive(&w, sizeof(struct wire))) > 0) {
+      if (got++ == 0)
+        heard = now();
+      packets_in++;
+      if (len < WIREHEADER + PKTHEADER || w.flow < 0 || w.flow >= nflows ||
+          w.packet.length != len - WIREHEADER - PKTHEADER) {
+        malformed++;
+        continue;
+      }
+      curflow = w.flow;
+      if (TRACE > 1)
+        printf("\nEVENT time: %f,  type: 2, entity: %d\n", heard / unit, 2 * curflow + side);
+      if (side == A)
+        A_input(&w.packet);
+      else
+        B_input(&w.packet);
+    }
+
+    /* everything sent this time round goes out together */
+    send_failed += tp->flush();
+
+    t = now();
+    if (t - heard > idle && (side == B || generated > 0)) {
+      printf("Warning: %c heard nothing for %.1f seconds, giving up\n", side == A ? 'A' : 'B', idle);
+      break;
+    }
+    if (side == A && generated == nmessages && atimers == 0 && heldcount == 0)
+      break;
+    if (side == B && delivered >= nmessages && t - lastdelivery > linger && heldcount == 0)
+      break;
+    tp->wait(nextwake(t) - t);
+  }
+}
+
+/* seconds of CPU time this process has used */
+static double cputime(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static void report(double elapsed, double began)
+{
+  int messages;
+
+  if (side == A) {
+    printf("A: number of messages sent:  %d \n", generated);
+    printf("A: number of packets sent:  %d \n", packets_sent);
+    printf("A: number of packet resends:  %d \n", packets_resent);
+    printf("A: number of correct ACKs:  %d \n", total_ACKs_received);
+    printf("A: number of messages dropped due to full window:  %d \n", window_full);
+    printf("A: number of messages queued because the window was full:  %d \n", messages_queued);
+    printf("A: elapsed seconds:  %f \n", elapsed);
+    printf("A: messages sent per second:  %f \n", elapsed > 0.0 ? generated / elapsed : 0.0);
+  }
+  else {
+    printf("B: number of messages delivered to application:  %d \n", delivered);
+    printf("B: number of packets received:  %d \n", packets_received);
+    printf("B: number of ACKs sent:  %d \n", acks_sent);
+    if (!file_enabled())
+      printf("B: messages delivered out of order:  %d \n", misordered);
+    printf("B: messages delivered per second:  %f \n",
+           lastdelivery > firstdelivery ? (delivered - 1) / (lastdelivery - firstdelivery) : 0.0);
+    if (file_enabled())
+      file_report(lastdelivery - began, 0.0);
+    else {
+      printf("B: average latency in microseconds:  %f \n", delivered ? 1e6 * latency_sum / delivered : 0.0);
+      printf("B: maximum latency in microseconds:  %f \n", 1e6 * latency_max);
+    }
+  }
+  messages = side == A ? generated : delivered;
+  printf("%c: number of system calls:  %ld \n", side == A ? 'A' : 'B', tp->syscalls());
+  printf("%c: system calls per message:  %f \n", side == A ? 'A' : 'B',
+         messages > 0 ? (double)tp->syscalls() / messages : 0.0);
+  printf("%c: CPU nanoseconds per packet sent or received:  %f \n", side == A ? 'A' : 'B',
+         packets_sent + packets_in > 0 ? 1e9 * cputime() / (packets_sent + packets_in) : 0.0);
+  if (shim_lost > 0)
+    printf("%c: number of packets lost by the shim:  %d \n", side == A ? 'A' : 'B', shim_lost);
+  if (send_failed > 0)
+    printf("%c: number of packets the %s transport could not send:  %d \n",
+           side == A ? 'A' : 'B', tp->name, send_failed);
+  if (malformed > 0)
+    printf("%c: number of malformed packets received:  %d \n", side == A ? 'A' : 'B', malformed);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *name, *role;
+  pid_t child = -1;
+  double began;
+  size_t i;
+
+  options_init(argc, argv);
+  TRACE = option_int("trace", 0);
+  unit = option_int("timeunit", 1000) / 1e6;
+  nmessages = option_int("messages", 10000);
+  interval = option_double("interval", 0.0) * unit;
+  shimloss = option_double("shimloss", 0.0);
+  shimdelay = option_double("shimdelay", 0.0) * unit;
+  nflows = option_int("flows", 1);
+  if (nflows < 1)
+    nflows = 1;
+  conns = calloc(nflows, sizeof(struct conn));
+  if (conns == NULL) {
+    printf("memory allocation for flows failed.");
+    exit(EXIT_FAILURE);
+  }
+  srand(option_int("seed", 9999));
+
+  name = option_string("transport", "udp");
+  tp = NULL;
+  for (i = 0; i < sizeof(transports) / sizeof(transports[0]); i++)
+    if (strcmp(transports[i]->name, name) == 0)
+      tp = transports[i];
+  if (tp == NULL) {
+    printf("unknown transport %s\n", name);
+    exit(EXIT_FAILURE);
+  }
+
+  /* with role=both, time 0 is the same for both sides */
+  start = clocknow();
+  role = option_string("role", "both");
+  if (strcmp(role, "a") == 0)
+    side = A;
+  else if (strcmp(role, "b") == 0)
+    side = B;
+  else if (strcmp(role, "both") == 0) {
+    fflush(stdout);
+    tp->open(B);
+    child = fork();
+    if (child < 0) {
+      perror("fork");
+      exit(EXIT_FAILURE);
+    }
+    side = child == 0 ? B : A;
+    if (side == A)
+      tp->close();
+  }
+  else {
+    printf("role must be a, b or both, not %s\n", role);
+    exit(EXIT_FAILURE);
+  }
+  if (child == -1 || side == A)
+    tp->open(side);
+  if (file_enabled()) {
+    file_init(side == A, side == B);
+    nmessages = file_chunks();
+  }
+
+  for (curflow = 0; curflow < nflows; curflow++) {
+    A_init();
+    B_init();
+    nready += ready(curflow);
+  }
+  began = now();
+  run();
+  tp->close();
+
+  /* B's report comes first */
+  if (child > 0)
+    waitpid(child, NULL, 0);
+  report(now() - began, began);
+  return 0;
+}
@@ -0,0 +1,39 @@
+/* the ways the real backend can carry packets between its A and B
+   processes, chosen with the transport option.  The backend opens the
+   B endpoint before it forks, so that B is ready for A's first packet,
+   then the A process closes its copy and opens the A endpoint. */
+
+/* the largest packet the backend sends: the flow number in front of a
+   struct pkt (emulator.h), which must be declared where this is used */
+#define WIRESIZE ((int)(sizeof(int) + sizeof(struct pkt)))
+
+struct transport {
+  const char *name;
+  void (*open)(int AorB);                     /* open the endpoint of side A or B */
+  void (*close)(void);
+  int (*send)(const void *data, int len);     /* send a packet to the other side, 0 if it could not */
+  int (*flush)(void);                         /* send the packets held back by send(), returns how many could not be */
+  int (*receive)(void *data, int max);        /* the length of the packet received, 0 if none is waiting */
+  void (*wait)(double timeout);               /* sleep until a packet may have arrived, at most timeout seconds */
+  long (*syscalls)(void);                     /* system calls made so far */
+};
+
+/* UDP on 127.0.0.1, A on port port and B on port+1.  Up to iobatch
+   packets go out in one sendmmsg() and come in with one recvmmsg(), and
+   with gso=1 runs of packets of the same size go out as one UDP GSO
+   send.  send() only holds packets back, the backend flushes them once
+   every time round its loop. */
+extern const struct transport udp_transport;
+
+/* the same socket driven through an io_uring: receives stay posted, sends
+   are queued as submissions, and the backend's wait is one timeout, so
+   one io_uring_enter() both submits and sleeps.  ringsize sets the
+   number of submission entries. */
+extern const struct transport uring_transport;
+
+/* two lock-free single-producer single-consumer rings, one each way, in
+   a shared memory segment named shmname (default /gbn_shm) with
+   shmslots slots each.  A receiver polls shmspin times before it sleeps
+   on a futex.  ringloss and ringcorrupt lose or corrupt packets as they
+   enter the ring.  With separate processes B must start first. */
+extern const struct transport shm_transport;
@@ -0,0 +1,246 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <arpa/inet.h>
+#include "emulator.h"
+#include "options.h"
+#include "transport.h"
+
+/* ******************************************************************
+   UDP transport for the real backend.  Each side has a non-blocking
+   socket bound to the loopback address.  With iobatch=1 every packet
+   is one sendto() and one recv(); otherwise outgoing packets collect
+   in a batch that goes out with one sendmmsg(), and received ones are
+   drained iobatch at a time with recvmmsg().  With gso=1 each run of
+   packets of the same size in a batch becomes one message that the
+   kernel splits into datagrams (UDP_SEGMENT), so a window resent by a
+   timeout costs one system call.
+**********************************************************************/
+
+#define MAXSEGMENTS 64              /* the most datagrams in one GSO message */
+
+static int sock = -1;
+static struct sockaddr_in peer;     /* the other side's address */
+static int batch;                   /* packets per sendmmsg() or recvmmsg() */
+static int gso;                     /* use UDP generic segmentation offload */
+static long calls;                  /* system calls made */
+
+static char *outbuf;                /* packets waiting to be sent, WIRESIZE bytes each */
+static int *outlen;
+static int nout;
+static int *outcount;               /* packets in each message */
+static struct mmsghdr *outmsg;
+static struct iovec *outiov;
+static char (*outctl)[CMSG_SPACE(sizeof(unsigned short))];
+
+static char *inbuf;                 /* packets received but not handed over yet, as outbuf */
+static struct mmsghdr *inmsg;
+static struct iovec *iniov;
+static int nin, inpos;
+
+static void *allocate(size_t size)
+{
+  void *p = calloc(1, size);
+
+  if (p == NULL) {
+    printf("memory allocation for socket batches failed.");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+static void address(struct sockaddr_in *a, int port)
+{
+  memset(a, 0, sizeof(struct sockaddr_in));
+  a->sin_family = AF_INET;
+  a->sin_port = htons(port);
+  a->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+}
+
+static void udp_open(int AorB)
+{
+  struct sockaddr_in self;
+  int port = option_int("port", 9000);
+  int size = option_int("sockbuf", 0);
+  int i;
+
+  batch = option_int("iobatch", 32);
+  gso = option_int("gso", 0) != 0;
+  if (batch < 1)
+    batch = 1;
+
+  sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sock < 0) {
+    perror("socket");
+    exit(EXIT_FAILURE);
+  }
+  address(&self, port + AorB);
+  address(&peer, port + 1 - AorB);
+  if (bind(sock, (struct sockaddr *)&self, sizeof(self)) < 0) {
+    perror("bind");
+    exit(EXIT_FAILURE);
+  }
+  if (size > 0) {
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  }
+  fcntl(sock, F_SETFL, fcntl(sock, F_GETFL) | O_NONBLOCK);
+
+  /* a segment size of 0 leaves segmentation off, but fails if the
+     kernel has no UDP GSO */
+  i = 0;
+  if (gso && setsockopt(sock, SOL_UDP, UDP_SEGMENT, &i, sizeof(i)) < 0) {
+    printf("Warning: UDP GSO is not supported, sending datagrams one by one\n");
+    gso = 0;
+  }
+
+  if (batch > 1 && outbuf == NULL) {
+    outbuf = allocate(batch * WIRESIZE);
+    outlen = allocate(batch * sizeof(int));
+    outcount = allocate(batch * sizeof(int));
+    outmsg = allocate(batch * sizeof(struct mmsghdr));
+    outiov = allocate(batch * sizeof(struct iovec));
+    outctl = allocate(batch * sizeof(*outctl));
+    inbuf = allocate(batch * WIRESIZE);
+    inmsg = allocate(batch * sizeof(struct mmsghdr));
+    iniov = allocate(batch * sizeof(struct iovec));
+    for (i = 0; i < batch; i++) {
+      iniov[i].iov_base = inbuf + i * WIRESIZE;
+      iniov[i].iov_len = WIRESIZE;
+      inmsg[i].msg_hdr.msg_iov = &iniov[i];
+      inmsg[i].msg_hdr.msg_iovlen = 1;
+    }
+  }
+  nout = nin = inpos = 0;
+}
+
+static void udp_close(void)
+{
+  close(sock);
+  sock = -1;
+}
+
+/* make message m carry the n packets from outbuf[first], as one GSO
+   message if n is above 1 */
+static void setmessage(struct mmsghdr *m, int first, int n)
+{
+  struct cmsghdr *cm;
+  int i;
+
+  memset(m, 0, sizeof(struct mmsghdr));
+  for (i = first; i < first + n; i++) {
+    outiov[i].iov_base = outbuf + i * WIRESIZE;
+    outiov[i].iov_len = outlen[i];
+  }
+  m->msg_hdr.msg_name = &peer;
+  m->msg_hdr.msg_namelen = sizeof(peer);
+  m->msg_hdr.msg_iov = &outiov[first];
+  m->msg_hdr.msg_iovlen = n;
+  if (n > 1) {
+    m->msg_hdr.msg_control = outctl[first];
+    m->msg_hdr.msg_controllen = sizeof(outctl[first]);
+    cm = CMSG_FIRSTHDR(&m->msg_hdr);
+    cm->cmsg_level = SOL_UDP;
+    cm->cmsg_type = UDP_SEGMENT;
+    cm->cmsg_len = CMSG_LEN(sizeof(unsigned short));
+    *(unsigned short *)CMSG_DATA(cm) = (unsigned short)outlen[first];
+  }
+}
+
+static int udp_flush(void)
+{
+  int nmsg = 0, sent = 0, first, n, r, failed = 0;
+
+  /* group the packets into messages, runs of the same size with GSO */
+  for (first = 0; first < nout; first += n) {
+    n = 1;
+    while (gso && first + n < nout && outlen[first + n] == outlen[first] &&
+           n < MAXSEGMENTS && (n + 1) * outlen[first] <= 65000)
+      n++;
+    setmessage(&outmsg[nmsg], first, n);
+    outcount[nmsg++] = n;
+  }
+  nout = 0;
+  while (sent < nmsg) {
+    calls++;
+    r = sendmmsg(sock, &outmsg[sent], nmsg - sent, 0);
+    if (r <= 0) {
+      /* the socket buffer is full, so the rest of the batch is lost */
+      for (; sent < nmsg; sent++)
+        failed += outcount[sent];
+      break;
+    }
+    sent += r;
+  }
+  return failed;
+}
+
+static int udp_send(const void *data, int len)
+{
+  if (len > WIRESIZE)
+    return 0;
+  if (batch <= 1) {
+    calls++;
+    return sendto(sock, data, len, 0, (struct sockaddr *)&peer, sizeof(peer)) == len;
+  }
+  if (nout == batch && udp_flush() > 0)
+    return 0;
+  memcpy(outbuf + nout * WIRESIZE, data, len);
+  outlen[nout++] = len;
+  return 1;
+}
+
+static int udp_receive(void *data, int max)
+{
+  ssize_t n;
+  int r;
+
+  if (batch <= 1) {
+    calls++;
+    n = recv(sock, data, max, 0);
+    return n > 0 ? (int)n : 0;
+  }
+  if (inpos == nin) {
+    calls++;
+    r = recvmmsg(sock, inmsg, batch, MSG_DONTWAIT, NULL);
+    nin = r > 0 ? r : 0;
+    inpos = 0;
+    if (nin == 0)
+      return 0;
+  }
+  n = inmsg[inpos].msg_len < (unsigned)max ? inmsg[inpos].msg_len : (unsigned)max;
+  memcpy(data, inbuf + inpos++ * WIRESIZE, n);
+  return (int)n;
+}
+
+static void udp_wait(double timeout)
+{
+  struct timeval tv;
+  fd_set fds;
+
+  if (timeout < 0.0)
+    timeout = 0.0;
+  tv.tv_sec = (long)timeout;
+  tv.tv_usec = (long)((timeout - tv.tv_sec) * 1e6);
+  FD_ZERO(&fds);
+  FD_SET(sock, &fds);
+  calls++;
+  select(sock + 1, &fds, NULL, NULL, &tv);
+}
+
+static long udp_syscalls(void)
+{
+  return calls;
+}
+
+const struct transport udp_transport = {
+  "udp", udp_open, udp_close, udp_send, udp_flush, udp_receive, udp_wait, udp_syscalls
+};
@@ -0,0 +1,406 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#include "options.h"
+#include "transport.h"
+
+/* ******************************************************************
+   io_uring transport for the real backend.  The UDP socket is driven
+   through one submission and completion ring set up with the raw
+   system calls: a pool of receives is kept posted on the socket, every
+   send is a submission, and the backend's wait is a single timeout
+   on the monotonic clock.  One io_uring_enter() submits everything
+   queued since the last one and sleeps until a completion arrives, so
+   a round of the backend's loop usually costs one system call.  The
+   protocol timers of all the flows live in the backend's heap; the ring
+   only ever holds the timeout of the earliest, which is replaced with a
+   TIMEOUT_REMOVE submission when an earlier one is wanted.
+**********************************************************************/
+
+#define BUFSIZE 1536            /* the largest packet, with room to spare */
+
+/* the kind of request, in the top bits of the user data */
+#define KIND_RECV    ((__u64)1 << 32)
+#define KIND_SEND    ((__u64)2 << 32)
+#define KIND_TIMEOUT ((__u64)3 << 32)
+#define KIND_REMOVE  ((__u64)4 << 32)
+#define KIND(u)      ((u) >> 32 << 32)
+#define INDEX(u)     ((unsigned)(u))
+
+static int sock = -1;
+static int ring = -1;            /* the io_uring, -1 until the first use */
+static unsigned entries;         /* submission queue size */
+static long calls;               /* system calls made */
+
+/* the submission ring */
+static unsigned *sqhead, *sqtail, *sqmask, *sqarray;
+static struct io_uring_sqe *sqes;
+static unsigned sqlocal;         /* our tail, ahead of *sqtail until submitted */
+static unsigned submitted;       /* tail last given to the kernel */
+
+/* the completion ring */
+static unsigned *cqhead, *cqtail, *cqmask;
+static struct io_uring_cqe *cqes;
+
+static void *sqmap, *cqmap;
+static size_t sqmaplen, cqmaplen;
+
+/* receive buffers, each posted on the socket until its packet is handed over */
+static char (*recvbuf)[BUFSIZE];
+static int nrecv;
+static int posted;               /* receives posted and not completed */
+static bool closing;             /* receives that complete are not posted again */
+static int *readyq;              /* received buffers in completion order, a circular FIFO */
+static int *readylen;
+static int readyhead, readycount;
+
+/* send buffers, a free stack */
+static char (*sendbuf)[BUFSIZE];
+static int nsend;
+static int *freesend;
+static int nfree;
+static int failed;               /* sends that completed with an error */
+
+/* the timeout posted, if any */
+static bool armed;
+static unsigned armgen;          /* its number, in its user data */
+static double armedat;           /* its expiry on the monotonic clock */
+static struct __kernel_timespec armts;
+
+static int enter(unsigned submit, unsigned wait, unsigned flags)
+{
+  calls++;
+  return (int)syscall(__NR_io_uring_enter, ring, submit, wait, flags, NULL, 0);
+}
+
+static void *allocate(size_t size)
+{
+  void *p = calloc(1, size);
+
+  if (p == NULL) {
+    printf("memory allocation for the io_uring transport failed.");
+    exit(EXIT_FAILURE);
+  }
+  return p;
+}
+
+/* give the kernel the submissions queued so far, without waiting */
+static void submit(void)
+{
+  __atomic_store_n(sqtail, sqlocal, __ATOMIC_RELEASE);
+  if (sqlocal != submitted) {
+    enter(sqlocal - submitted, 0, 0);
+    submitted = sqlocal;
+  }
+}
+
+/* a cleared submission queue entry, submitting first if the ring is full */
+static struct io_uring_sqe *getsqe(void)
+{
+  struct io_uring_sqe *sqe;
+  unsigned index;
+
+  if (sqlocal - __atomic_load_n(sqhead, __ATOMIC_ACQUIRE) == entries)
+    submit();
+  index = sqlocal & *sqmask;
+  sqe = &sqes[index];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+  sqarray[index] = index;
+  sqlocal++;
+  return sqe;
+}
+
+static void postrecv(int i)
+{
+  struct io_uring_sqe *sqe = getsqe();
+
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = sock;
+  sqe->addr = (unsigned long)recvbuf[i];
+  sqe->len = BUFSIZE;
+  sqe->user_data = KIND_RECV | i;
+  posted++;
+}
+
+/* handle the completions that have arrived */
+static void reap(void)
+{
+  unsigned head = *cqhead;
+  struct io_uring_cqe *cqe;
+
+  while (head != __atomic_load_n(cqtail, __ATOMIC_ACQUIRE)) {
+    cqe = &cqes[head & *cqmask];
+    switch (KIND(cqe->user_data)) {
+    case KIND_RECV:
+      posted--;
+      if (closing)
+        break;
+      if (cqe->res > 0) {
+        readyq[(readyhead + readycount) % nrecv] = INDEX(cqe->user_data);
+        readylen[(readyhead + readycount) % nrecv] = cqe->res;
+        readycount++;
+      }
+      else
+        postrecv(INDEX(cqe->user_data));
+      break;
+    case KIND_SEND:
+      if (cqe->res < 0)
+        failed++;
+      freesend[nfree++] = INDEX(cqe->user_data);
+      break;
+    case KIND_TIMEOUT:
+      if (INDEX(cqe->user_data) == armgen)
+        armed = false;
+      break;
+    default:
+      break;
+    }
+    head++;
+  }
+  __atomic_store_n(cqhead, head, __ATOMIC_RELEASE);
+}
+
+static void uring_open(int AorB)
+{
+  struct sockaddr_in self, peer;
+  int port = option_int("port", 9000);
+  int size = option_int("sockbuf", 0);
+
+  sock = socket(AF_INET, SOCK_DGRAM, 0);
+  if (sock < 0) {
+    perror("socket");
+    exit(EXIT_FAILURE);
+  }
+  memset(&self, 0, sizeof(self));
+  self.sin_family = AF_INET;
+  self.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  peer = self;
+  self.sin_port = htons(port + AorB);
+  peer.sin_port = htons(port + 1 - AorB);
+  if (bind(sock, (struct sockaddr *)&self, sizeof(self)) < 0 ||
+      connect(sock, (struct sockaddr *)&peer, sizeof(peer)) < 0) {
+    perror("bind");
+    exit(EXIT_FAILURE);
+  }
+  if (size > 0) {
+    setsockopt(sock, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+    setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+  }
+}
+
+/* set up the ring in the process that uses it, after the fork, since
+   the buffers of the requests belong to the process that submits them */
+static void setup(void)
+{
+  struct io_uring_params p;
+  int i;
+
+  entries = option_int("ringsize", 256);
+  if (entries < 8)
+    entries = 8;
+  memset(&p, 0, sizeof(p));
+  ring = (int)syscall(__NR_io_uring_setup, entries, &p);
+  if (ring < 0) {
+    perror("io_uring_setup");
+    exit(EXIT_FAILURE);
+  }
+  entries = p.sq_entries;
+  sqmaplen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  cqmaplen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if (p.features & IORING_FEAT_SINGLE_MMAP) {
+    if (cqmaplen > sqmaplen)
+      sqmaplen = cqmaplen;
+    cqmaplen = 0;
+  }
+  sqmap = mmap(NULL, sqmaplen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQ_RING);
+  cqmap = cqmaplen == 0 ? sqmap :
+    mmap(NULL, cqmaplen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_CQ_RING);
+  sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+              MAP_SHARED | MAP_POPULATE, ring, IORING_OFF_SQES);
+  if (sqmap == MAP_FAILED || cqmap == MAP_FAILED || sqes == MAP_FAILED) {
+    perror("mmap");
+    exit(EXIT_FAILURE);
+  }
+  sqhead = (unsigned *)((char *)sqmap + p.sq_off.head);
+  sqtail = (unsigned *)((char *)sqmap + p.sq_off.tail);
+  sqmask = (unsigned *)((char *)sqmap + p.sq_off.ring_mask);
+  sqarray = (unsigned *)((char *)sqmap + p.sq_off.array);
+  cqhead = (unsigned *)((char *)cqmap + p.cq_off.head);
+  cqtail = (unsigned *)((char *)cqmap + p.cq_off.tail);
+  cqmask = (unsigned *)((char *)cqmap + p.cq_off.ring_mask);
+  cqes = (struct io_uring_cqe *)((char *)cqmap + p.cq_off.cqes);
+  sqlocal = submitted = *sqtail;
+
+  /* a quarter of the ring receives, half of it sends, leaving room for
+     the timeout and its removal; the completion ring is twice as big */
+  nrecv = entries / 4;
+  nsend = entries / 2;
+  recvbuf = allocate(nrecv * sizeof(*recvbuf));
+  readyq = allocate(nrecv * sizeof(int));
+  readylen = allocate(nrecv * sizeof(int));
+  sendbuf = allocate(nsend * sizeof(*sendbuf));
+  freesend = allocate(nsend * sizeof(int));
+  for (nfree = 0; nfree < nsend; nfree++)
+    freesend[nfree] = nfree;
+  readyhead = readycount = failed = 0;
+  armed = false;
+  for (i = 0; i < nrecv; i++)
+    postrecv(i);
+  submit();
+}
+
+static void uring_close(void)
+{
+  if (ring < 0) {
+    close(sock);
+    sock = -1;
+    return;
+  }
+  /* finish the requests in flight first, or they keep the socket and
+     its port until the ring is torn down, after the process exits */
+  closing = true;
+  shutdown(sock, SHUT_RDWR);
+  submit();
+  reap();
+  while (posted > 0 || nfree < nsend) {
+    enter(0, 1, IORING_ENTER_GETEVENTS);
+    reap();
+  }
+  closing = false;
+  close(sock);
+  close(ring);
+  munmap(sqes, entries * sizeof(struct io_uring_sqe));
+  if (cqmap != sqmap)
+    munmap(cqmap, cqmaplen);
+  munmap(sqmap, sqmaplen);
+  free(recvbuf);
+  free(readyq);
+  free(readylen);
+  free(sendbuf);
+  free(freesend);
+  ring = sock = -1;
+}
+
+static int uring_send(const void *data, int len)
+{
+  struct io_uring_sqe *sqe;
+  int i;
+
+  if (ring < 0)
+    setup();
+  if (len > BUFSIZE)
+    return 0;
+  /* every send buffer is in flight: wait for one to come back */
+  while (nfree == 0) {
+    submit();
+    reap();
+    if (nfree == 0) {
+      enter(0, 1, IORING_ENTER_GETEVENTS);
+      reap();
+    }
+  }
+  i = freesend[--nfree];
+  memcpy(sendbuf[i], data, len);
+  sqe = getsqe();
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = sock;
+  sqe->addr = (unsigned long)sendbuf[i];
+  sqe->len = len;
+  sqe->user_data = KIND_SEND | i;
+  return 1;
+}
+
+static int uring_flush(void)
+{
+  int n;
+
+  if (ring < 0)
+    setup();
+  submit();
+  reap();
+  n = failed;
+  failed = 0;
+  return n;
+}
+
+static int uring_receive(void *data, int max)
+{
+  int i, len;
+
+  if (ring < 0)
+    setup();
+  if (readycount == 0)
+    reap();
+  if (readycount == 0)
+    return 0;
+  i = readyq[readyhead];
+  len = readylen[readyhead] < max ? readylen[readyhead] : max;
+  readyhead = (readyhead + 1) % nrecv;
+  readycount--;
+  memcpy(data, recvbuf[i], len);
+  postrecv(i);
+  return len;
+}
+
+static void uring_wait(double timeout)
+{
+  struct io_uring_sqe *sqe;
+  struct timespec ts;
+  double at;
+
+  if (ring < 0)
+    setup();
+  reap();
+  if (readycount > 0 || timeout <= 0.0) {
+    submit();
+    return;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  at = ts.tv_sec + ts.tv_nsec / 1e9 + timeout;
+
+  /* a posted timeout that expires no later will do, otherwise replace it */
+  if (!armed || armedat > at) {
+    if (armed) {
+      sqe = getsqe();
+      sqe->opcode = IORING_OP_TIMEOUT_REMOVE;
+      sqe->addr = KIND_TIMEOUT | armgen;
+      sqe->user_data = KIND_REMOVE;
+    }
+    armed = true;
+    armedat = at;
+    armts.tv_sec = (long)at;
+    armts.tv_nsec = (long)((at - (long)at) * 1e9);
+    sqe = getsqe();
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->addr = (unsigned long)&armts;
+    sqe->len = 1;
+    sqe->timeout_flags = IORING_TIMEOUT_ABS;
+    sqe->user_data = KIND_TIMEOUT | ++armgen;
+  }
+  __atomic_store_n(sqtail, sqlocal, __ATOMIC_RELEASE);
+  if (enter(sqlocal - submitted, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR && errno != ETIME)
+    perror("io_uring_enter");
+  submitted = sqlocal;
+  reap();
+}
+
+static long uring_syscalls(void)
+{
+  return calls;
+}
+
+const struct transport uring_transport = {
+  "uring", uring_open, uring_close, uring_send, uring_flush, uring_receive, uring_wait, uring_syscalls
+};